@@ -3,6 +3,12 @@
 #include "imu.h"
 #include <Wire.h>
 #include "bmp085.h"
+#include "baro.h"
+#include "devicestate.h"
+#include "forecast.h"
+#include "median.h"
+#include "spectrum.h"
+#include "trig.h"
 #include <EspSoftSerialRx.h>
 #include <CircularBuffer.h>
 #include "bma180.h"
@@ -10,129 +16,163 @@
 Adafruit_BMP085 bmp085;
 BMA180 bma180;
 
-EspSoftSerialRx gps;
-String nmeaLine;
+#define RECORD_TIMEOUT 1100	// ms, emit a record without a fresh fix after this long
+#define GPS_SAMPLE_INTERVAL 0	// ms between GPS fixes, 0 keeps the receiver on all the time
+#define GPS_WAKE_LEAD 5000		// ms the receiver is woken before the next fix is due, enough for a hot start
+#define GPS_ACQUIRE_TIMEOUT 120000	// ms a woken receiver searches without a fix before it's put back to sleep
+#define GPS_BACKUP_INTERVAL 86400	// s between receiver state backups, each one writes flash
 
-bool gotGprmc;
-String gpsTime;
-String gpsDate;
-String gpsLat;
-String gpsLong;
+static_assert((GPS_SAMPLE_INTERVAL == 0) || (GPS_SAMPLE_INTERVAL > GPS_WAKE_LEAD), "GPS_SAMPLE_INTERVAL must be longer than GPS_WAKE_LEAD");
 
-String getNextNmeaToken(String& line, int& start)
+Ublox ublox;
+
+// 1Hz NAV-PVT only, the UART carries nothing we don't decode
+const UbxProfile gpsProfile = { 1000, false, 1, 0, 0 };
+
+GpsFix fix;	// last fix published by NAV-PVT or a complete RMC
+bool gotFix;
+bool gpsCycleFix;	// a valid fix has come in since the receiver last woke
+uint32_t gpsMicros;	// time spent in serviceGps() during this loop
+uint32_t lastRecord;
+
+// Never waits for the receiver, Ublox::service() only decodes what has already arrived
+void serviceGps()
 {
-	String result;
-	int i = start;
+	uint32_t start = micros();
 
-	while (i < line.length())
+	if ((!ublox.isAsleep()) && ublox.service())
 	{
-		char c = line[i];
+		fix = ublox.getFix();
+		gotFix = true;
 
-		if (c == ',')
-		{
-			if (start < i)
-				result = line.substring(start, i);
-			else
-				result = "";
-			start = i+1;
-			break;
-		}
-		++i;
+		gpsCycleFix |= fix.valid;
+
+		//the age is by GPS time, so reboots don't restart the interval
+		if (fix.valid && (ublox.getBackupAge() >= GPS_BACKUP_INTERVAL))
+			ublox.saveState();
 	}
 
-	return result;
+#if GPS_SAMPLE_INTERVAL > 0
+	//back up until just before the next fix is due, once this cycle has its fix or has searched long
+	//enough, checked on every call since a receiver without a fix may publish nothing at all
+	if ((!ublox.isAsleep()) && (!ublox.isSaving()) && (gpsCycleFix || (ublox.getOnTime() >= GPS_ACQUIRE_TIMEOUT)))
+	{
+		ublox.sleep(GPS_SAMPLE_INTERVAL - GPS_WAKE_LEAD);
+		gpsCycleFix = false;
+	}
+#endif
+
+	gpsMicros += micros() - start;
 }
 
-void parseNmeaLine()
+#define BARO_TEMPERATURE_EVERY 8		// pressure samples per temperature conversion
+#define BARO_TEMPERATURE_INTERVAL 5000	// ms, temperature is refreshed at least this often
+#define BARO_DECIMATION 4				// log2, ULTRALOWPOWER conversions averaged per pressure output
+
+BaroSampler baro(bmp085);
+
+int baroT;	// 0.1 degC
+int32_t baroP;	// Pa << BARO_FRAC_BITS, decimated
+
+PressureHistory pressureHistory;
+int32_t stationAltitude;	// cm, from the last valid fix, for the sea level pressure the forecast needs
+
+// Keeps one BMP085 conversion in flight and picks it up when it's done, so loop() never sits in delay()
+void serviceBaro()
 {
-	//GPS Fix message
-	if (nmeaLine.startsWith("$GPRMC,"))
+	baro.service();
+
+	while (baro.available())
 	{
-		Serial.println(nmeaLine);
+		baroP = baro.read();
+		baroT = (int)(bmp085.getTemperature() * 10);
+		pressureHistory.update(millis(), (baroP + (1 << (BARO_FRAC_BITS - 1))) >> BARO_FRAC_BITS);
+	}
+}
 
-		int i = 7;
-		gpsTime = getNextNmeaToken(nmeaLine, i);
-		String okStr = getNextNmeaToken(nmeaLine, i);
+#define BMA_FILTER BMA180::F10HZ
+#define BMA_RANGE BMA180::G1
 
-		if (okStr == "A")
-		{
-			gpsLat = getNextNmeaToken(nmeaLine, i);
-			String lnsStr = getNextNmeaToken(nmeaLine, i);
-			gpsLat += lnsStr;
-
-			gpsLong = getNextNmeaToken(nmeaLine, i);
-			String lewStr = getNextNmeaToken(nmeaLine, i);
-			gpsLong += lewStr;
-
-			String spdStr = getNextNmeaToken(nmeaLine, i);
-			String crsStr = getNextNmeaToken(nmeaLine, i);
-			gpsDate = getNextNmeaToken(nmeaLine, i);
-			String magStr = getNextNmeaToken(nmeaLine, i);
-		}
-		else
-		{
-			gpsLat = "";
-			gpsLong = "";
-			gpsTime = "";
-			gpsDate = "";
-		}
-		
-		gotGprmc = true;
-
-		/*
-		Serial.print("t=");
-		Serial.print(datStr);
-		Serial.print(";");
-		Serial.print(timeStr);
-		Serial.print(",");
-		Serial.print(latStr);
-		Serial.print(lnsStr);
-		Serial.print(",");
-		Serial.print(lonStr);
-		Serial.print(lewStr);
-		Serial.print(",ok=");
-		Serial.print(okStr);
-		Serial.print(",m=");
-		Serial.print(magStr);
-		Serial.println("");
-		*/
+// After a deep sleep wake the sensors still hold their setup, so only their IDs are checked
+// against the RTC copy. Otherwise they're programmed from scratch and the copy is rewritten.
+// Returns true if the saved state was used.
+bool beginSensors()
+{
+	DeviceState state;
+	bool warm = loadDeviceState(state);
+	bool changed = false;
+
+	if (!(warm && bmp085.begin(state.bmp, BMP085_ULTRALOWPOWER)))
+	{
+		bmp085.begin(BMP085_ULTRALOWPOWER);
+		state.bmp = bmp085.getCalibration();
+		changed = true;
 	}
-	/*
-	//GPS Fix message
-	if (nmeaLine.startsWith("$GPGGA,"))
+
+	int id = -1, version = -1;
+	bool bmaFound = bma180.getIDs(&id, &version);
+	if (!bmaFound || changed || (state.bmaId != (byte)id) || (state.bmaVersion != (byte)version) ||
+		(state.bmaFilter != BMA_FILTER) || (state.bmaRange != BMA_RANGE))
 	{
-		int i = 7;
-		String timeStr = getNextNmeaToken(nmeaLine, i);
-		String latStr = getNextNmeaToken(nmeaLine, i);
-		String lnsStr = getNextNmeaToken(nmeaLine, i);
-		String lonStr = getNextNmeaToken(nmeaLine, i);
-		String lewStr = getNextNmeaToken(nmeaLine, i);
-		String fixStr = getNextNmeaToken(nmeaLine, i);
-		String numStr = getNextNmeaToken(nmeaLine, i);
-		String hdpStr = getNextNmeaToken(nmeaLine, i);
-		String altStr = getNextNmeaToken(nmeaLine, i);
-
-		Serial.print("g=");
-		Serial.print(timeStr);
-		Serial.print(",");
-		Serial.print(latStr);
-		Serial.print(lnsStr);
-		Serial.print(",");
-		Serial.print(lonStr);
-		Serial.print(lewStr);
-		Serial.print(",f=");
-		Serial.print(fixStr);
-		Serial.print(",n=");
-		Serial.print(numStr);
-		Serial.print(",h=");
-		Serial.print(hdpStr);
-		Serial.print(",a=");
-		Serial.print(altStr);
-		Serial.println("");
+		bma180.SetFilter(BMA_FILTER);
+		bma180.setGSensitivty(BMA_RANGE);
+		bma180.commit();
+		state.bmaId = id;
+		state.bmaVersion = version;
+		state.bmaFilter = BMA_FILTER;
+		state.bmaRange = BMA_RANGE;
+		changed = true;
+	}
+	else
+	{
+		//the chip kept its range, the conversions still need to know it
+		bma180.restoreGSensitivity((BMA180::GSENSITIVITY)state.bmaRange);
+	}
+
+	//without the IDs the state would match nothing real, program again on the next boot
+	if (changed && bmaFound)
+		saveDeviceState(state);
+	return !changed;
+}
+
+#define BMA_INT_PIN 13	// BMA180 INT, data ready
+
+#define ACCEL_BLOCK 16	// samples unpacked per drain()
+
+int16_t accelX[ACCEL_BLOCK];
+int16_t accelY[ACCEL_BLOCK];
+int16_t accelZ[ACCEL_BLOCK];
+uint32_t accelTime[ACCEL_BLOCK];
+int32_t accelSum[3];	// since the last record, for its mean
+uint16_t accelSamples;
+
+VibrationSpectrum vibration;	// mast motion, from every sample
+
+// Reads the sample the data ready ISR flagged, then takes everything queued a block at a time
+void serviceAccel()
+{
+	//at most one sample per loop, whatever the chip produces faster than that is counted in bma180.missed
+	bma180.service();
+
+	uint16_t n;
+	while ((n = bma180.drain(accelX, accelY, accelZ, NULL, accelTime, ACCEL_BLOCK)) > 0)
+	{
+		vibration.push(accelX, accelY, accelZ, accelTime, n);
+		for (uint16_t i = 0; i < n; i++)
+		{
+			accelSum[0] += accelX[i];
+			accelSum[1] += accelY[i];
+			accelSum[2] += accelZ[i];
+		}
+		accelSamples += n;
 	}
-	*/
 }
 
+#define HUMIDITY_WINDOW 9	// analogRead() samples in the humidity outlier test
+#define HUMIDITY_MIN 20		// ADC counts, smaller deviations are never outliers
+
+HampelFilter<HUMIDITY_WINDOW> humidity(3, HUMIDITY_MIN);
+
 void setup()
 {
 	Serial.begin(115200);
@@ -140,61 +180,72 @@ void setup()
 	pinMode(4, INPUT_PULLUP);
 	pinMode(5, INPUT_PULLUP);
 
-	bmp085.begin(BMP085_ULTRAHIGHRES);
-
-	bma180.SetFilter(BMA180::FILTER::F10HZ);
-	bma180.setGSensitivty(BMA180::G1);
+	uint32_t start = micros();
+	bool restored = beginSensors();
+	Serial.printf("sensors %s in %lu us, %u transactions\n", restored ? "restored" : "programmed",
+		(unsigned long)(micros() - start), (unsigned)(bmp085.transactions + bma180.transactions));
 
-	//gps.begin(9600, 12);
+	bmp085.setTemperatureRefresh(BARO_TEMPERATURE_EVERY, BARO_TEMPERATURE_INTERVAL);
+	baro.begin(BARO_DECIMATION);
+	bma180.beginISR(BMA_INT_PIN);
 
+	if (ublox.begin())
+	{
+		if (!ublox.configure(gpsProfile))
+			Serial.println("gps config failed");
+#if GPS_SAMPLE_INTERVAL > 0
+		ublox.setPowerMode(Ublox::PM_BACKUP);
+		//backup drops whatever wasn't saved, the receiver would wake at 9600 with only NMEA on
+		if (!ublox.saveConfig())
+			Serial.println("gps config save failed");
+#endif
+		ublox.restoreState();
+	}
+	else
+	{
+		Serial.println("gps not found");
+	}
 }
 
 void loop()
 {
+	gpsMicros = 0;
+	serviceGps();
+	serviceBaro();
 
-  /* add main program code here */
-	Serial.println("A");
-	gps.setEnabled(false);
+	int h = humidity.update(analogRead(A0));
 
-	int h = analogRead(A0);
-	
-	int t = (int)(bmp085.readTemperature() * 10);
+	serviceAccel();
+	serviceGps();
+	serviceBaro();
 
-	int p = bmp085.readPressure();
+	//one record per fix, or a record with the stale fix if the receiver has gone quiet
+	if ((!gotFix) && (millis() - lastRecord < RECORD_TIMEOUT))
+		return;
+	gotFix = false;
+	lastRecord = millis();
 
-	bma180.readAccel();
-//	Serial.printf("a=%d,%d,%d\n", (int16_t)bma180.x, (int16_t)bma180.y, (int16_t)bma180.z);
-	float rx = atan2f((int16_t)bma180.x, (int16_t)bma180.y) * 180 / 3.141592f;
-	float ry = atan2f((int16_t)bma180.x, (int16_t)bma180.z) * 180 / 3.141592f;
-	
-	gps.setEnabled(true);
-	gps.reset();
-	int timeout = 0;
-	while (!gotGprmc)
+	//the record carries the mean acceleration since the last one, the last mean if nothing came in
+	if (accelSamples)
 	{
-		delay(50);
+		bma180.x = accelSum[0] / accelSamples;
+		bma180.y = accelSum[1] / accelSamples;
+		bma180.z = accelSum[2] / accelSamples;
+		accelSum[0] = accelSum[1] = accelSum[2] = 0;
+	}
+//	Serial.printf("a=%d,%d,%d\n", (int16_t)bma180.x, (int16_t)bma180.y, (int16_t)bma180.z);
+	//tilt in millidegrees
+	int32_t rx = atan2Milli((int16_t)bma180.x, (int16_t)bma180.y);
+	int32_t ry = atan2Milli((int16_t)bma180.x, (int16_t)bma180.z);
 
-		byte c;
-		while (gps.read(c))
-		{
-			Serial.print((char)c);
-			if (c > 13)
-			{
-				nmeaLine += (char)c;
-			}
-			else
-			{
-				parseNmeaLine();
-				nmeaLine = "";
-			}
-		}
+	const SpectrumResult& vib = vibration.getResult();
 
-		timeout++;
-		if ((timeout > 10) && (!gotGprmc))
-			break;
-	}
-	gotGprmc = false;
-	Serial.println("B");
+	int t = baroT;
+	int p = (baroP + (1 << (BARO_FRAC_BITS - 1))) >> BARO_FRAC_BITS;
+
+	if (fix.valid)
+		stationAltitude = fix.altitude;
+	int forecast = pressureHistory.forecast(Adafruit_BMP085::altitudeToSealevel(p, stationAltitude));
 
 	//Serial.print(nmeaLine);
 	//nmeaLine = "";
@@ -225,20 +276,37 @@ void loop()
 	Serial.print(",");
 	Serial.println(ry);
 	*/
-	Serial.printf("%s,%s,%s,%s,%d,%d,%d,%d,%d,%d,%d,%d\n", 
-		gpsDate.c_str(),
-		gpsTime.c_str(),
-		gpsLat.c_str(),
-		gpsLong.c_str(),
+	Serial.printf("%d,%lu,%ld,%ld,%ld,%u,%u,%d,%d,%u,%d,%d,%d,%d,%d,%d,%d,%d,%lu,%lu,%lu,%ld,%d,%u,%u,%u,%u,%lu,%lu,%lu,%lu\n", 
+		fix.valid,
+		(unsigned long)fix.time,
+		(long)fix.lat,
+		(long)fix.lon,
+		(long)fix.altitude,
+		fix.speed,
+		fix.course,
+		fix.quality,
+		fix.satellites,
+		fix.hdop,
 		t,
 		p,
 		h,
 		(int16_t)bma180.x,
 		(int16_t)bma180.y,
 		(int16_t)bma180.z,
-		(int)(rx*1000),
-		(int)(ry*1000));
-
-	gps.service();
-
+		(int)rx,
+		(int)ry,
+		(unsigned long)gpsMicros,
+		(unsigned long)ublox.cycleOnTime,
+		(unsigned long)ublox.ttff,
+		(long)pressureHistory.tendency(),
+		forecast,
+		accelSamples,
+		bma180.missed,
+		vib.frequency,
+		vib.rms,
+		(unsigned long)vib.bands[0],
+		(unsigned long)vib.bands[1],
+		(unsigned long)vib.bands[2],
+		(unsigned long)vib.bands[3]);
+	accelSamples = 0;
 }
@@ -0,0 +1,100 @@
+// 
+// 
+// 
+
+#include "baro.h"
+
+CicDecimator::CicDecimator()
+{
+	begin(0);
+}
+
+void CicDecimator::begin(uint8_t r)
+{
+	if (r > BARO_MAX_DECIMATION)
+		r = BARO_MAX_DECIMATION;
+	log2R = r;
+	settle = 2;
+	phase = 0;
+	integ1 = 0;
+	integ2 = 0;
+	comb1 = 0;
+	comb2 = 0;
+}
+
+bool CicDecimator::push(int32_t x, int32_t& y)
+{
+	integ1 += (uint32_t)x;
+	integ2 += integ1;
+
+	if (++phase < (1 << log2R))
+		return false;
+	phase = 0;
+
+	uint32_t d1 = integ2 - comb1;
+	comb1 = integ2;
+	int32_t d2 = (int32_t)(d1 - comb2);
+	comb2 = d1;
+
+	if (settle)
+	{
+		settle--;
+		return false;
+	}
+
+	//gain is R^2, take it out and keep BARO_FRAC_BITS of the extra resolution
+	int8_t shift = 2 * log2R - BARO_FRAC_BITS;
+	if (shift > 0)
+		y = (d2 + (1L << (shift - 1))) >> shift;
+	else
+		y = d2 << -shift;
+	return true;
+}
+
+BaroSampler::BaroSampler(Adafruit_BMP085& b) : bmp(b), spikes(3, BARO_HAMPEL_MIN)
+{
+	samples = 0;
+	output = 0;
+	ready = false;
+}
+
+void BaroSampler::begin(uint8_t log2Decimation)
+{
+	bmp.setOversampling(BMP085_ULTRALOWPOWER);
+	cic.begin(log2Decimation);
+	spikes.clear();
+	raw.clear();
+	ready = false;
+}
+
+void BaroSampler::service()
+{
+	if (!bmp.isReady())
+		return;
+
+	if (bmp.collect() == BMP085_PRESSURE)
+	{
+		raw.push(spikes.update(bmp.getPressure()));
+		samples++;
+	}
+
+	if (bmp.temperatureDue())
+		bmp.startTemperature();
+	else
+		bmp.startPressure();
+}
+
+bool BaroSampler::available()
+{
+	int32_t p;
+	while ((!ready) && raw.pop(p))
+		ready = cic.push(p, output);
+	return ready;
+}
+
+int32_t BaroSampler::read()
+{
+	available();
+	ready = false;
+	return output;
+}
@@ -0,0 +1,76 @@
+// baro.h
+
+#ifndef _BARO_h
+#define _BARO_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "bmp085.h"
+#include "ringbuffer.h"
+#include "median.h"
+
+#define BARO_FRAC_BITS 4		// decimated pressure is Pa << BARO_FRAC_BITS
+#define BARO_MAX_DECIMATION 6	// log2, 64 samples per output keeps 110 kPa * R^2 inside 32 bits
+#define BARO_RAW_SIZE 32		// compensated samples waiting for the decimator
+#define BARO_HAMPEL_WINDOW 9	// conversions the outlier test looks at
+#define BARO_HAMPEL_MIN 50		// Pa, smaller deviations are never outliers, a bad read is far more
+
+// Second order CIC (cascaded moving average) decimator by R = 2^log2R. The integrators
+// run in unsigned arithmetic and wrap harmlessly, the combs only run once per output.
+class CicDecimator
+{
+public:
+	CicDecimator();
+
+	void begin(uint8_t log2R);
+
+	// Returns true when y holds a new output, in input units << BARO_FRAC_BITS
+	bool push(int32_t x, int32_t& y);
+
+private:
+	uint8_t log2R;
+	uint8_t settle;		// outputs still to discard while the combs fill
+	uint16_t phase;
+	uint32_t integ1, integ2;
+	uint32_t comb1, comb2;
+};
+
+// Runs the BMP085 at ULTRALOWPOWER back to back and decimates the stream. Averaging
+// R short conversions cuts the noise by about sqrt(R), for less noise per unit of time
+// than the chip's own oversampling and any output rate. It costs bus time: every
+// conversion is a start and a read, where ULTRAHIGHRES averages 8 samples per read, so
+// for the same noise the chip's oversampling uses the bus less. A Hampel filter in front
+// of the decimator keeps a bad read from being smeared across the next outputs.
+class BaroSampler
+{
+public:
+	BaroSampler(Adafruit_BMP085& bmp);
+
+	// log2Decimation conversions per output, e.g. 4 gives one output per 16 conversions
+	void begin(uint8_t log2Decimation);
+
+	// Collects a finished conversion and starts the next one, call as often as possible
+	void service();
+
+	// Decimated pressure in Pa << BARO_FRAC_BITS
+	bool available();
+	int32_t read();
+
+	uint32_t samples;	// pressure conversions collected
+	uint16_t getOutliers() const { return spikes.outliers; }
+
+private:
+	Adafruit_BMP085& bmp;
+	HampelFilter<BARO_HAMPEL_WINDOW> spikes;
+	RingBuffer<int32_t, BARO_RAW_SIZE> raw;
+	CicDecimator cic;
+	int32_t output;
+	bool ready;
+};
+
+#endif
+
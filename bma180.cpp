@@ -9,12 +9,22 @@ BMA180::BMA180(unsigned char a)
 {
 	address = a;
 	gSense = G2;
+	setScale();
+	missed = 0;
+	transactions = 0;
+	dirty = 0;
+	shadowValid = false;
 }
 
 BMA180::BMA180()
 {
 	address = 0x40;
 	gSense = G1;
+	setScale();
+	missed = 0;
+	transactions = 0;
+	dirty = 0;
+	shadowValid = false;
 }
 
 void BMA180::SetAddress(int adr)
@@ -22,99 +32,202 @@ void BMA180::SetAddress(int adr)
 	address = (unsigned char)adr;
 }
 
-int x, y, z;
-int temp;
-
 void BMA180::readAccel()
 {
-	unsigned int result;
+	AccelRaw r;
+	if (!readRaw(r))
+		return;
 
-	Wire.beginTransmission(address);
-	Wire.write(0x02);
-	Wire.endTransmission();
-	Wire.requestFrom((int)address, 7);
-	if (Wire.available() == 7)
-	{
-		int lsb = Wire.read() >> 2;
-		int msb = Wire.read();
-		x = (msb << 6) + lsb;
-		if (x & 0x2000) x |= 0xc000; // set full 2 complement for neg values
-		lsb = Wire.read() >> 2;
-		msb = Wire.read();
-		y = (msb << 6) + lsb;
-		if (y & 0x2000) y |= 0xc000;
-		lsb = Wire.read() >> 2;
-		msb = Wire.read();
-		z = (msb << 6) + lsb;
-		if (z & 0x2000) z |= 0xc000;
-		temp = Wire.read();
-		if (temp & 0x80) temp |= 0xff00;
-	}
-	result = Wire.endTransmission();
+	int16_t v[4];
+	unpack(&r, &v[0], &v[1], &v[2], &v[3], NULL, 1);
+	x = v[0];
+	y = v[1];
+	z = v[2];
+	temp = v[3];
+}
+
+//full scale of each GSENSITIVITY in milli-g
+static const uint16_t rangeMilliG[] = { 1000, 1500, 2000, 3000, 4000, 8000, 16000 };
+
+void BMA180::setScale()
+{
+	//anything unknown is taken as the chip's power on range of 2g
+	uint16_t range = (gSense <= G16) ? rangeMilliG[gSense] : 2000;
+	scale = ((int32_t)range * 65536 + BMA180_FULL_SCALE / 2) / BMA180_FULL_SCALE;
+	gScale = range / (1000.0f * BMA180_FULL_SCALE);
 }
 
 float BMA180::getGSense()
 {
-	switch (gSense)
-	{
-	case G1: return 1.0;
-	case G15: return 1.5;
-	case G2: return 2.0;
-	case G3: return 3.0;
-	case G4: return 4.0;
-	case G8: return 8.0;
-	case G16: return 16.0;
-	}
+	return gScale * BMA180_FULL_SCALE;
 }
 
 float BMA180::getXValFloat()
 {
 	// normalize (if x is maximum (8191) and GSENSE=1.0 then 1.0
-	return (float)x / 8191.0*getGSense();
+	return x * gScale;
 }
 float BMA180::getYValFloat()
 {
 	// normalize (if x is maximum (8191) and GSENSE=1.0 then 1.0
-	return (float)y / 8191.0*getGSense();
+	return y * gScale;
 }
 float BMA180::getZValFloat()
 {
 	// normalize (if x is maximum (8191) and GSENSE=1.0 then 1.0
-	return (float)z / 8191.0*getGSense();
+	return z * gScale;
+}
+
+void BMA180::toMilliG(const int16_t* counts, int16_t* mg, uint16_t n) const
+{
+	//8191 * 16g in Q16 is under 2^31
+	const int32_t k = scale;
+	for (uint16_t i = 0; i < n; i++)
+		mg[i] = (int16_t)((counts[i] * k + 0x8000) >> 16);
+}
+
+void BMA180::toMilliGQ16(const int16_t* counts, int32_t* mg, uint16_t n) const
+{
+	const int32_t k = scale;
+	for (uint16_t i = 0; i < n; i++)
+		mg[i] = counts[i] * k;
+}
+
+void BMA180::toG(const int16_t* counts, float* g, uint16_t n) const
+{
+	const float k = gScale;
+	for (uint16_t i = 0; i < n; i++)
+		g[i] = counts[i] * k;
 }
 
 int BMA180::getRegValue(int adr)
 {
-	int val;
-	Wire.beginTransmission(address);
-	Wire.write(adr);
-	Wire.endTransmission();
-	Wire.requestFrom((int)address, 1);
-	if (Wire.available() == 1)
-	{
-		val = Wire.read();
-	}
-	else val = -1;
-	int result = Wire.endTransmission();
-	checkResult(result);
+	if (shadowValid && (adr >= BMA180_SHADOW_FIRST) && (adr <= BMA180_IMAGE_LAST))
+		return shadow[adr - BMA180_SHADOW_FIRST];
+
+	byte val;
+	if (!readRegs(adr, &val, 1))
+		return -1;
 	return val;
 }
 
 void BMA180::setRegValue(int regAdr, int val, int maskPreserve)
 {
+	//image registers wait in the shadow for commit()
+	if ((regAdr >= BMA180_IMAGE_FIRST) && (regAdr <= BMA180_IMAGE_LAST) && (shadowValid || begin()))
+	{
+		byte i = regAdr - BMA180_SHADOW_FIRST;
+		byte v = (shadow[i] & maskPreserve) | val;
+		if (v != shadow[i])
+		{
+			shadow[i] = v;
+			dirty |= 1ULL << i;
+		}
+		return;
+	}
+
 	int preserve = getRegValue(regAdr);
-	int orgval = preserve & maskPreserve;
+	if (preserve < 0)
+		return;
+
+	//without the shadow an image register still needs ee_w around its write
+	bool image = (regAdr >= BMA180_IMAGE_FIRST) && (regAdr <= BMA180_IMAGE_LAST);
+	int ctrl0 = image ? getRegValue(BMA180_CTRL_REG0) : BMA180_EE_W;
+	if (ctrl0 < 0)
+		return;
+
+	if (!(ctrl0 & BMA180_EE_W))
+		writeReg(BMA180_CTRL_REG0, ctrl0 | BMA180_EE_W);
+	writeReg(regAdr, (preserve & maskPreserve) | val);
+	if (!(ctrl0 & BMA180_EE_W))
+		writeReg(BMA180_CTRL_REG0, ctrl0);
+}
+
+bool BMA180::begin()
+{
+	//in pieces the Wire buffer can hold, requestFrom() silently truncates anything longer
+	shadowValid = false;
+	for (byte i = 0; i < BMA180_SHADOW_SIZE; i += BMA180_READ_CHUNK)
+	{
+		byte len = BMA180_SHADOW_SIZE - i;
+		if (len > BMA180_READ_CHUNK)
+			len = BMA180_READ_CHUNK;
+		if (!readRegs(BMA180_SHADOW_FIRST + i, shadow + i, len))
+		{
+			dirty = 0;
+			return false;
+		}
+	}
+	shadowValid = true;
+	dirty = 0;
+	return true;
+}
+
+bool BMA180::commit()
+{
+	if (!dirty)
+		return true;
+
+	byte ctrl0 = shadow[0];
+	bool ok = true;
+
+	if (!(ctrl0 & BMA180_EE_W))
+		ok &= writeReg(BMA180_CTRL_REG0, ctrl0 | BMA180_EE_W);
+
+	for (byte i = 0; i < BMA180_SHADOW_SIZE; i++)
+	{
+		if (dirty & (1ULL << i))
+			ok &= writeReg(BMA180_SHADOW_FIRST + i, shadow[i]);
+	}
+
+	//leave ee_w as it was
+	if (!(ctrl0 & BMA180_EE_W))
+		ok &= writeReg(BMA180_CTRL_REG0, ctrl0);
+
+	dirty = 0;
+	return ok;
+}
+
+bool BMA180::readRegs(byte reg, byte* buf, byte len)
+{
 	Wire.beginTransmission(address);
-	Wire.write(regAdr);
-	Wire.write(orgval | val);
-	int result = Wire.endTransmission();
-	checkResult(result);
+	Wire.write(reg);
+	Wire.endTransmission(false);
+	Wire.requestFrom((int)address, (int)len);
+	transactions++;
 
+	if (Wire.available() != len)
+		return false;
+	for (byte i = 0; i < len; i++)
+		buf[i] = Wire.read();
+	return true;
+}
+
+bool BMA180::writeReg(byte reg, byte val)
+{
+	Wire.beginTransmission(address);
+	Wire.write(reg);
+	Wire.write(val);
+	transactions++;
+	if (!checkResult(Wire.endTransmission()))
+		return false;
+
+	if (shadowValid && (reg >= BMA180_SHADOW_FIRST) && (reg <= BMA180_IMAGE_LAST))
+		shadow[reg - BMA180_SHADOW_FIRST] = val;
+	return true;
 }
 
 void BMA180::setGSensitivty(GSENSITIVITY maxg) //1, 1.5 2 3 4 8 16
 {
 	setRegValue(0x35, maxg << 1, 0xF1);
+	gSense = maxg;
+	setScale();
+}
+
+void BMA180::restoreGSensitivity(GSENSITIVITY maxg)
+{
+	gSense = maxg;
+	setScale();
 }
 
 void BMA180::SetFilter(FILTER f) // 10,20,40,75,150,300,600,1200, HP 1HZ,BP 0.2-300, higher values not authorized
@@ -129,8 +242,11 @@ void BMA180::SetISRMode() // you must provide a ISR function on the pin selected
 
 void BMA180::SoftReset() // all values will be default
 {
-	setRegValue(0x10, 0xB6, 0);
+	writeReg(BMA180_SOFT_RESET, 0xB6);
 	delay(100);
+	//the image registers are back to their EEPROM values
+	shadowValid = false;
+	dirty = 0;
 }
 
 void BMA180::SetSMPSkip()
@@ -140,34 +256,30 @@ void BMA180::SetSMPSkip()
 
 int BMA180::getIDs(int *id, int *version)
 {
-	Wire.beginTransmission(address);
-	Wire.write(0x0);
-	Wire.endTransmission();
-	Wire.requestFrom((int)address, 2);
-	if (Wire.available() == 2)
+	//chip_id and version are registers 0x00 and 0x01
+	byte buf[2];
+	if (!readRegs(0x00, buf, 2))
 	{
-		*id = Wire.read();
-		*version = Wire.read();
+		*id = -1;
+		*version = -1;
+		return false;
 	}
-	else *id = -1;
-	int result = Wire.endTransmission();
-	checkResult(result);
-	return *id != -1;
+	*id = buf[0];
+	*version = buf[1];
+	return true;
 }
 
 
 void BMA180::enableWrite()
 {
-	//ctrl_reg1 register set ee_w bit to enable writing to regs.
-	setRegValue(0x0D, 0x10, ~0x10);
-	delay(10);
+	//ctrl_reg0 register set ee_w bit to enable writing to regs.
+	setRegValue(BMA180_CTRL_REG0, BMA180_EE_W, ~BMA180_EE_W);
 }
 
 
 void BMA180::disableWrite()
 {
-	setRegValue(0x0D, 0x0, ~0x10);
-	delay(10);
+	setRegValue(BMA180_CTRL_REG0, 0x0, ~BMA180_EE_W);
 }
 
 bool BMA180::checkResult(int result)
@@ -177,3 +289,155 @@ bool BMA180::checkResult(int result)
 	return true;
 }
 
+
+volatile uint8_t BMA180::readyCount;
+volatile uint32_t BMA180::readyTime;
+
+void BMA180::beginISR(int pin)
+{
+	samples.clear();
+
+	SetISRMode();
+	commit();
+
+	readyCount = 0;
+	pinMode(pin, INPUT);
+	attachInterrupt(digitalPinToInterrupt(pin), isr, RISING);
+
+	//the line may already be high with data nobody read, reading it lets the next sample raise it
+	AccelRaw r;
+	readRaw(r);
+}
+
+void ICACHE_RAM_ATTR BMA180::isr()
+{
+	readyTime = micros();
+	if (readyCount < 0xFF)
+		readyCount++;
+}
+
+void BMA180::service()
+{
+	noInterrupts();
+	uint8_t count = readyCount;
+	uint32_t time = readyTime;
+	readyCount = 0;
+	interrupts();
+
+	if (count == 0)
+		return;
+
+	AccelRaw r;
+	if (!readRaw(r))
+	{
+		//the data is still unread, try again next time round
+		noInterrupts();
+		if (readyCount == 0)
+			readyCount = 1;
+		interrupts();
+		return;
+	}
+
+	//no new_data_x means an edge after the snapshot had its sample read by the last call, so
+	//the sample announced before it was overwritten rather than this one being new
+	if (!(r.data[0] & 0x01))
+	{
+		missed += count;
+		return;
+	}
+
+	//every edge but the last announced a sample the chip has since overwritten
+	missed += count - 1;
+	r.time = time;
+	samples.push(r);
+}
+
+bool BMA180::readRaw(AccelRaw& r)
+{
+	Wire.beginTransmission(address);
+	Wire.write(0x02);
+	Wire.endTransmission(false);
+	Wire.requestFrom((int)address, 7);
+	if (Wire.available() != 7)
+		return false;
+
+	for (byte i = 0; i < 7; i++)
+		r.data[i] = Wire.read();
+	r.time = micros();
+	return true;
+}
+
+void BMA180::unpack(const AccelRaw* raw, int16_t* x, int16_t* y, int16_t* z, int16_t* temp, uint32_t* time, uint16_t n)
+{
+	//14 bits left justified in msb:lsb, the arithmetic shift of the 16 bit word does the sign extension
+	for (uint16_t i = 0; i < n; i++)
+	{
+		const byte* d = raw[i].data;
+		x[i] = (int16_t)(d[0] | (d[1] << 8)) >> 2;
+		y[i] = (int16_t)(d[2] | (d[3] << 8)) >> 2;
+		z[i] = (int16_t)(d[4] | (d[5] << 8)) >> 2;
+	}
+
+	if (temp)
+	{
+		for (uint16_t i = 0; i < n; i++)
+			temp[i] = (int8_t)raw[i].data[6];
+	}
+
+	if (time)
+	{
+		for (uint16_t i = 0; i < n; i++)
+			time[i] = raw[i].time;
+	}
+}
+
+uint16_t BMA180::drain(int16_t* x, int16_t* y, int16_t* z, int16_t* temp, uint32_t* time, uint16_t n)
+{
+	AccelRaw raw[BMA180_UNPACK_BLOCK];
+	uint16_t done = 0;
+
+	while (done < n)
+	{
+		uint16_t k = 0;
+		while ((k < BMA180_UNPACK_BLOCK) && (done + k < n) && samples.pop(raw[k]))
+			k++;
+		if (k == 0)
+			break;
+
+		unpack(raw, x + done, y + done, z + done, temp ? temp + done : NULL, time ? time + done : NULL, k);
+		done += k;
+	}
+	return done;
+}
+
+uint16_t BMA180::readAccelBurst(int16_t* x, int16_t* y, int16_t* z, int16_t* temp, uint32_t* time, uint16_t n)
+{
+	AccelRaw raw[BMA180_UNPACK_BLOCK];
+	uint16_t done = 0;
+	uint32_t start = millis();
+
+	while (done < n)
+	{
+		uint16_t k = 0;
+		while ((k < BMA180_UNPACK_BLOCK) && (done + k < n))
+		{
+			if (!readRaw(raw[k]))
+				break;
+			//new_data_x is cleared by the read, a sample without it is one we already have
+			if (raw[k].data[0] & 0x01)
+			{
+				k++;
+				start = millis();
+			}
+			else if (millis() - start > BMA180_BURST_TIMEOUT)
+				break;
+		}
+
+		if (k)
+			unpack(raw, x + done, y + done, z + done, temp ? temp + done : NULL, time ? time + done : NULL, k);
+		done += k;
+		if (k < BMA180_UNPACK_BLOCK)
+			break;
+	}
+	return done;
+}
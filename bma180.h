@@ -9,7 +9,30 @@
 	#include "WProgram.h"
 #endif
 
+#include "ringbuffer.h"
+
 #define BMA180_DEFAULT_ADDRESS 0x40
+#define BMA180_SAMPLE_BUFFER 64	// samples the data ready interrupt can queue between drains
+
+#define BMA180_CTRL_REG0 0x0D
+#define BMA180_EE_W 0x10			// ctrl_reg0, unlocks writes to the image registers
+#define BMA180_SOFT_RESET 0x10
+#define BMA180_IMAGE_FIRST 0x20		// bw_tcs, first of the image (configuration) registers
+#define BMA180_IMAGE_LAST 0x35		// offset_lsb1, range and smp_skip
+#define BMA180_SHADOW_FIRST BMA180_CTRL_REG0
+#define BMA180_SHADOW_SIZE (BMA180_IMAGE_LAST - BMA180_SHADOW_FIRST + 1)
+#define BMA180_READ_CHUNK 32		// bytes per burst read, the Wire buffer on the ESP8266 core
+
+#define BMA180_FULL_SCALE 8191	// counts at the top of the range
+#define BMA180_UNPACK_BLOCK 16	// raw samples staged on the stack per unpack() call
+#define BMA180_BURST_TIMEOUT 100	// ms readAccelBurst() waits for fresh data
+
+// Registers 0x02-0x08 as read, x, y and z lsb/msb then temp, and when they were taken
+struct AccelRaw
+{
+	byte data[7];
+	uint32_t time;	// micros() of the data ready edge, or of the read when polled
+};
 
 class BMA180
 {
@@ -19,6 +42,9 @@ public:
 private:
 	unsigned char address;
 	GSENSITIVITY gSense;
+	int32_t scale;	// milli-g per count in Q16, for gSense
+	float gScale;	// g per count
+	void setScale();
 public:
 
 	int x, y, z; // yes, public, what the heck
@@ -34,9 +60,19 @@ public:
 	float getXValFloat();
 	float getYValFloat();
 	float getZValFloat();
+
+	// Whole blocks of counts, e.g. from drain(), in the current range. The scale is worked out
+	// once by setGSensitivty() so these are a multiply per sample.
+	void toMilliG(const int16_t* counts, int16_t* mg, uint16_t n) const;		// rounded milli-g
+	void toMilliGQ16(const int16_t* counts, int32_t* mg, uint16_t n) const;	// milli-g in Q16
+	void toG(const int16_t* counts, float* g, uint16_t n) const;
+	int32_t getScale() const { return scale; }	// milli-g per count in Q16
 	void setRegValue(int regAdr, int val, int maskPreserve);
 	int getRegValue(int adr);
 	void setGSensitivty(GSENSITIVITY maxg);
+	// The range the chip already holds, e.g. after a deep sleep, so the conversions scale
+	// right without touching the bus
+	void restoreGSensitivity(GSENSITIVITY maxg);
 	void SetFilter(FILTER f);
 	void SetISRMode();
 	void SoftReset();
@@ -45,6 +81,49 @@ public:
 	void enableWrite();
 	void disableWrite();
 	virtual bool checkResult(int result);
+
+	// Reads ctrl_reg0 to offset_lsb1 into a shadow copy in one burst. From then on the setters
+	// for the image registers only change the shadow, and commit() writes whatever changed
+	// inside a single ee_w window. Loaded on first use if not called.
+	bool begin();
+	bool commit();
+
+	uint16_t transactions;	// register (not sample) I2C transactions, to see what the shadow saves
+
+	// Enables the new data interrupt on pin. The ISR only notes the time and counts the edge,
+	// the registers are read by service() so the bus is never touched from interrupt context.
+	void beginISR(int pin);
+	// Reads the sample the last data ready edge announced into samples, call from loop()
+	void service();
+
+	// Unpacks up to n queued samples into separate arrays, temp (degrees, offset per the datasheet)
+	// and time may be NULL. Returns how many there were.
+	uint16_t drain(int16_t* x, int16_t* y, int16_t* z, int16_t* temp, uint32_t* time, uint16_t n);
+
+	// Polled alternative to the ISR, reads n samples as the chip flags new data, giving up
+	// after BMA180_BURST_TIMEOUT ms without one. Returns how many were read. Use one or the
+	// other: a burst read clears new_data behind service()'s back, so with beginISR() live the
+	// samples get split between the two and the edges it consumed are dropped as stale.
+	uint16_t readAccelBurst(int16_t* x, int16_t* y, int16_t* z, int16_t* temp, uint32_t* time, uint16_t n);
+
+	// Raw registers to 14 bit signed values, branch free
+	static void unpack(const AccelRaw* raw, int16_t* x, int16_t* y, int16_t* z, int16_t* temp, uint32_t* time, uint16_t n);
+
+	RingBuffer<AccelRaw, BMA180_SAMPLE_BUFFER> samples;	// filled by service(), unpacked by drain()
+	uint16_t missed;	// samples the chip replaced before service() read them, one per extra edge
+
+private:
+	static void isr();
+	bool readRaw(AccelRaw& r);
+	bool readRegs(byte reg, byte* buf, byte len);
+	bool writeReg(byte reg, byte val);
+
+	byte shadow[BMA180_SHADOW_SIZE];
+	uint64_t dirty;		// bit per shadow register changed since the last commit()
+	bool shadowValid;
+
+	static volatile uint8_t readyCount;	// data ready edges since service() last looked
+	static volatile uint32_t readyTime;	// micros() of the latest
 };
 
 
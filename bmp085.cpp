@@ -3,6 +3,7 @@
 // 
 
 #include "bmp085.h"
+#include "fastmath.h"
 
 /***************************************************
 This is a library for the Adafruit BMP085/BMP180 Barometric Pressure + Temp sensor
@@ -18,7 +19,71 @@ Written by Limor Fried/Ladyada for Adafruit Industries.
 BSD license, all text above must be included in any redistribution
 ****************************************************/
 
+/*********************************************************************/
+
+// the datasheet maths, shared by the driver and the batch kernel below
+
+static inline int32_t bmp085B5(const Bmp085Calibration &cal, int32_t UT) {
+	int32_t X1 = (UT - (int32_t)cal.ac6) * ((int32_t)cal.ac5) >> 15;
+	int32_t X2 = ((int32_t)cal.mc << 11) / (X1 + (int32_t)cal.md);
+	return X1 + X2;
+}
+
+static inline int32_t bmp085Pressure(const Bmp085Calibration &cal, uint8_t oversampling, int32_t B5, int32_t UP) {
+	int32_t B3, B6, X1, X2, X3, p;
+	uint32_t B4, B7;
+
+	B6 = B5 - 4000;
+	X1 = ((int32_t)cal.b2 * ((B6 * B6) >> 12)) >> 11;
+	X2 = ((int32_t)cal.ac2 * B6) >> 11;
+	X3 = X1 + X2;
+	B3 = ((((int32_t)cal.ac1 * 4 + X3) << oversampling) + 2) / 4;
+
+	X1 = ((int32_t)cal.ac3 * B6) >> 13;
+	X2 = ((int32_t)cal.b1 * ((B6 * B6) >> 12)) >> 16;
+	X3 = ((X1 + X2) + 2) >> 2;
+	B4 = ((uint32_t)cal.ac4 * (uint32_t)(X3 + 32768)) >> 15;
+	B7 = ((uint32_t)UP - B3) * (uint32_t)(50000UL >> oversampling);
+
+	// the datasheet's (B7 * 2) / B4 when B7 < 0x80000000, else (B7 / B4) * 2, from one divide
+	// and without a branch so the batch loop stays straight line code
+	uint32_t q = B7 / B4;
+	uint32_t r = B7 - q * B4;
+	p = (q * 2) + ((r * 2 >= B4) & (B7 < 0x80000000));
+
+	X1 = (p >> 8) * (p >> 8);
+	X1 = (X1 * 3038) >> 16;
+	X2 = (-7357 * p) >> 16;
+
+	return p + ((X1 + X2 + (int32_t)3791) >> 4);
+}
+
+void bmp085Compensate(const Bmp085Calibration *cal, uint8_t oversampling,
+	const int32_t *ut, const int32_t *up, int32_t *temperature, int32_t *pressure, size_t n) {
+	const Bmp085Calibration c = *cal;  // local copy so the compiler knows the outputs can't alias it
+
+	for (size_t i = 0; i < n; i++) {
+		int32_t B5 = bmp085B5(c, ut[i]);
+		temperature[i] = (B5 + 8) >> 4;
+		pressure[i] = bmp085Pressure(c, oversampling, B5, up[i]);
+	}
+}
+
+/*********************************************************************/
+
 Adafruit_BMP085::Adafruit_BMP085() {
+	conversion = BMP085_IDLE;
+	conversionStart = 0;
+	conversionTime = 0;
+	lastUT = 0;
+	lastUP = 0;
+	transactions = 0;
+	cachedB5 = 0;
+	b5Valid = false;
+	refreshEvery = 1;
+	refreshInterval = 0;
+	pressureCount = 0;
+	temperatureTime = 0;
 }
 
 
@@ -31,92 +96,186 @@ boolean Adafruit_BMP085::begin(uint8_t mode) {
 
 	if (read8(0xD0) != 0x55) return false;
 
-	/* read calibration data */
-	ac1 = read16(BMP085_CAL_AC1);
-	ac2 = read16(BMP085_CAL_AC2);
-	ac3 = read16(BMP085_CAL_AC3);
-	ac4 = read16(BMP085_CAL_AC4);
-	ac5 = read16(BMP085_CAL_AC5);
-	ac6 = read16(BMP085_CAL_AC6);
+	/* read calibration data, all 11 words 0xAA-0xBF in one burst */
+	uint8_t buf[22];
+	readBytes(BMP085_CAL_AC1, buf, sizeof(buf));
 
-	b1 = read16(BMP085_CAL_B1);
-	b2 = read16(BMP085_CAL_B2);
+	cal.ac1 = (buf[0] << 8) | buf[1];
+	cal.ac2 = (buf[2] << 8) | buf[3];
+	cal.ac3 = (buf[4] << 8) | buf[5];
+	cal.ac4 = (buf[6] << 8) | buf[7];
+	cal.ac5 = (buf[8] << 8) | buf[9];
+	cal.ac6 = (buf[10] << 8) | buf[11];
 
-	mb = read16(BMP085_CAL_MB);
-	mc = read16(BMP085_CAL_MC);
-	md = read16(BMP085_CAL_MD);
+	cal.b1 = (buf[12] << 8) | buf[13];
+	cal.b2 = (buf[14] << 8) | buf[15];
+
+	cal.mb = (buf[16] << 8) | buf[17];
+	cal.mc = (buf[18] << 8) | buf[19];
+	cal.md = (buf[20] << 8) | buf[21];
 #if (BMP085_DEBUG == 1)
-	Serial.print("ac1 = "); Serial.println(ac1, DEC);
-	Serial.print("ac2 = "); Serial.println(ac2, DEC);
-	Serial.print("ac3 = "); Serial.println(ac3, DEC);
-	Serial.print("ac4 = "); Serial.println(ac4, DEC);
-	Serial.print("ac5 = "); Serial.println(ac5, DEC);
-	Serial.print("ac6 = "); Serial.println(ac6, DEC);
-
-	Serial.print("b1 = "); Serial.println(b1, DEC);
-	Serial.print("b2 = "); Serial.println(b2, DEC);
-
-	Serial.print("mb = "); Serial.println(mb, DEC);
-	Serial.print("mc = "); Serial.println(mc, DEC);
-	Serial.print("md = "); Serial.println(md, DEC);
+	Serial.print("ac1 = "); Serial.println(cal.ac1, DEC);
+	Serial.print("ac2 = "); Serial.println(cal.ac2, DEC);
+	Serial.print("ac3 = "); Serial.println(cal.ac3, DEC);
+	Serial.print("ac4 = "); Serial.println(cal.ac4, DEC);
+	Serial.print("ac5 = "); Serial.println(cal.ac5, DEC);
+	Serial.print("ac6 = "); Serial.println(cal.ac6, DEC);
+
+	Serial.print("b1 = "); Serial.println(cal.b1, DEC);
+	Serial.print("b2 = "); Serial.println(cal.b2, DEC);
+
+	Serial.print("mb = "); Serial.println(cal.mb, DEC);
+	Serial.print("mc = "); Serial.println(cal.mc, DEC);
+	Serial.print("md = "); Serial.println(cal.md, DEC);
 #endif
 
 	return true;
 }
 
+boolean Adafruit_BMP085::begin(const Bmp085Calibration &stored, uint8_t mode) {
+	setOversampling(mode);
+
+	Wire.begin();
+
+	if (read8(0xD0) != 0x55) return false;
+
+	cal = stored;
+	return true;
+}
+
+void Adafruit_BMP085::setOversampling(uint8_t mode) {
+	if (mode > BMP085_ULTRAHIGHRES)
+		mode = BMP085_ULTRAHIGHRES;
+	oversampling = mode;
+}
+
 int32_t Adafruit_BMP085::computeB5(int32_t UT) {
-	int32_t X1 = (UT - (int32_t)ac6) * ((int32_t)ac5) >> 15;
-	int32_t X2 = ((int32_t)mc << 11) / (X1 + (int32_t)md);
-	return X1 + X2;
+	return bmp085B5(cal, UT);
 }
 
-uint16_t Adafruit_BMP085::readRawTemperature(void) {
+void Adafruit_BMP085::startTemperature(void) {
 	write8(BMP085_CONTROL, BMP085_READTEMPCMD);
-	delay(5);
-#if BMP085_DEBUG == 1
-	Serial.print("Raw temp: "); Serial.println(read16(BMP085_TEMPDATA));
-#endif
-	return read16(BMP085_TEMPDATA);
+	conversion = BMP085_TEMPERATURE;
+	conversionStart = millis();
+	conversionTime = 5;
 }
 
-uint32_t Adafruit_BMP085::readRawPressure(void) {
-	uint32_t raw;
-
+void Adafruit_BMP085::startPressure(void) {
 	write8(BMP085_CONTROL, BMP085_READPRESSURECMD + (oversampling << 6));
+	conversion = BMP085_PRESSURE;
+	conversionStart = millis();
 
 	if (oversampling == BMP085_ULTRALOWPOWER)
-		delay(5);
+		conversionTime = 5;
 	else if (oversampling == BMP085_STANDARD)
-		delay(8);
+		conversionTime = 8;
 	else if (oversampling == BMP085_HIGHRES)
-		delay(14);
+		conversionTime = 14;
 	else
-		delay(26);
+		conversionTime = 26;
+}
 
-	raw = read16(BMP085_PRESSUREDATA);
+boolean Adafruit_BMP085::isReady(void) {
+	// millis() can tick just after the start, so wait one extra ms to cover the full conversion
+	return (conversion == BMP085_IDLE) || (millis() - conversionStart > conversionTime);
+}
 
-	raw <<= 8;
-	raw |= read8(BMP085_PRESSUREDATA + 2);
-	raw >>= (8 - oversampling);
+uint8_t Adafruit_BMP085::collect(void) {
+	uint8_t collected = conversion;
 
-	/* this pull broke stuff, look at it later?
-	if (oversampling==0) {
-	raw <<= 8;
-	raw |= read8(BMP085_PRESSUREDATA+2);
-	raw >>= (8 - oversampling);
+	if (conversion == BMP085_TEMPERATURE) {
+		lastUT = read16(BMP085_TEMPDATA);
+#if BMP085_DEBUG == 1
+		Serial.print("Raw temp: "); Serial.println(lastUT);
+#endif
+		cachedB5 = computeB5(lastUT);
+		b5Valid = true;
+		pressureCount = 0;
+		temperatureTime = millis();
 	}
-	*/
+	else if (conversion == BMP085_PRESSURE) {
+		uint32_t raw;
+		uint8_t data[3];
+
+		// MSB, LSB and XLSB in one burst
+		readBytes(BMP085_PRESSUREDATA, data, 3);
+
+		raw = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+		raw >>= (8 - oversampling);
+
+		/* this pull broke stuff, look at it later?
+		if (oversampling==0) {
+		raw <<= 8;
+		raw |= read8(BMP085_PRESSUREDATA+2);
+		raw >>= (8 - oversampling);
+		}
+		*/
 
 #if BMP085_DEBUG == 1
-	Serial.print("Raw pressure: "); Serial.println(raw);
+		Serial.print("Raw pressure: "); Serial.println(raw);
 #endif
-	return raw;
+		lastUP = raw;
+		if (pressureCount < 0xFF)
+			pressureCount++;
+	}
+
+	conversion = BMP085_IDLE;
+	return collected;
+}
+
+uint16_t Adafruit_BMP085::readRawTemperature(void) {
+	startTemperature();
+	delay(conversionTime);
+	collect();
+	return lastUT;
+}
+
+uint32_t Adafruit_BMP085::readRawPressure(void) {
+	startPressure();
+	delay(conversionTime);
+	collect();
+	return lastUP;
+}
+
+float Adafruit_BMP085::getTemperature(void) {
+	float temp;
+
+	temp = (cachedB5 + 8) >> 4;
+	temp /= 10;
+
+	return temp;
+}
+
+int32_t Adafruit_BMP085::getPressure(void) {
+	return computePressure(cachedB5, lastUP);
+}
+
+void Adafruit_BMP085::setTemperatureRefresh(uint8_t every, uint32_t interval) {
+	refreshEvery = every;
+	refreshInterval = interval;
+}
+
+boolean Adafruit_BMP085::temperatureDue(void) {
+	if (!b5Valid)
+		return true;
+	if ((refreshEvery != 0) && (pressureCount >= refreshEvery))
+		return true;
+	if ((refreshInterval != 0) && (millis() - temperatureTime >= refreshInterval))
+		return true;
+	return false;
 }
 
+void Adafruit_BMP085::readTemperatureAndPressure(float *temperature, int32_t *pressure) {
+	if (temperatureDue())
+		readRawTemperature();
+	readRawPressure();
+
+	*temperature = getTemperature();
+	*pressure = getPressure();
+}
 
 int32_t Adafruit_BMP085::readPressure(void) {
-	int32_t UT, UP, B3, B5, B6, X1, X2, X3, p;
-	uint32_t B4, B7;
+	int32_t UT, UP, B5;
 
 	UT = readRawTemperature();
 	UP = readRawPressure();
@@ -125,71 +284,30 @@ int32_t Adafruit_BMP085::readPressure(void) {
 	// use datasheet numbers!
 	UT = 27898;
 	UP = 23843;
-	ac6 = 23153;
-	ac5 = 32757;
-	mc = -8711;
-	md = 2868;
-	b1 = 6190;
-	b2 = 4;
-	ac3 = -14383;
-	ac2 = -72;
-	ac1 = 408;
-	ac4 = 32741;
+	cal.ac6 = 23153;
+	cal.ac5 = 32757;
+	cal.mc = -8711;
+	cal.md = 2868;
+	cal.b1 = 6190;
+	cal.b2 = 4;
+	cal.ac3 = -14383;
+	cal.ac2 = -72;
+	cal.ac1 = 408;
+	cal.ac4 = 32741;
 	oversampling = 0;
 #endif
 
 	B5 = computeB5(UT);
 
 #if BMP085_DEBUG == 1
-	Serial.print("X1 = "); Serial.println(X1);
-	Serial.print("X2 = "); Serial.println(X2);
 	Serial.print("B5 = "); Serial.println(B5);
 #endif
 
-	// do pressure calcs
-	B6 = B5 - 4000;
-	X1 = ((int32_t)b2 * ((B6 * B6) >> 12)) >> 11;
-	X2 = ((int32_t)ac2 * B6) >> 11;
-	X3 = X1 + X2;
-	B3 = ((((int32_t)ac1 * 4 + X3) << oversampling) + 2) / 4;
-
-#if BMP085_DEBUG == 1
-	Serial.print("B6 = "); Serial.println(B6);
-	Serial.print("X1 = "); Serial.println(X1);
-	Serial.print("X2 = "); Serial.println(X2);
-	Serial.print("B3 = "); Serial.println(B3);
-#endif
-
-	X1 = ((int32_t)ac3 * B6) >> 13;
-	X2 = ((int32_t)b1 * ((B6 * B6) >> 12)) >> 16;
-	X3 = ((X1 + X2) + 2) >> 2;
-	B4 = ((uint32_t)ac4 * (uint32_t)(X3 + 32768)) >> 15;
-	B7 = ((uint32_t)UP - B3) * (uint32_t)(50000UL >> oversampling);
-
-#if BMP085_DEBUG == 1
-	Serial.print("X1 = "); Serial.println(X1);
-	Serial.print("X2 = "); Serial.println(X2);
-	Serial.print("B4 = "); Serial.println(B4);
-	Serial.print("B7 = "); Serial.println(B7);
-#endif
-
-	if (B7 < 0x80000000) {
-		p = (B7 * 2) / B4;
-	}
-	else {
-		p = (B7 / B4) * 2;
-	}
-	X1 = (p >> 8) * (p >> 8);
-	X1 = (X1 * 3038) >> 16;
-	X2 = (-7357 * p) >> 16;
-
-#if BMP085_DEBUG == 1
-	Serial.print("p = "); Serial.println(p);
-	Serial.print("X1 = "); Serial.println(X1);
-	Serial.print("X2 = "); Serial.println(X2);
-#endif
+	return computePressure(B5, UP);
+}
 
-	p = p + ((X1 + X2 + (int32_t)3791) >> 4);
+int32_t Adafruit_BMP085::computePressure(int32_t B5, int32_t UP) {
+	int32_t p = bmp085Pressure(cal, oversampling, B5, UP);
 #if BMP085_DEBUG == 1
 	Serial.print("p = "); Serial.println(p);
 #endif
@@ -197,9 +315,7 @@ int32_t Adafruit_BMP085::readPressure(void) {
 }
 
 int32_t Adafruit_BMP085::readSealevelPressure(float altitude_meters) {
-	return 0;
-	//float pressure = readPressure();
-	//return (int32_t)(pressure / pow(1.0 - altitude_meters / 44330, 5.255));
+	return altitudeToSealevel(readPressure(), (int32_t)(altitude_meters * 100));
 }
 
 float Adafruit_BMP085::readTemperature(void) {
@@ -211,10 +327,10 @@ float Adafruit_BMP085::readTemperature(void) {
 #if BMP085_DEBUG == 1
 	// use datasheet numbers!
 	UT = 27898;
-	ac6 = 23153;
-	ac5 = 32757;
-	mc = -8711;
-	md = 2868;
+	cal.ac6 = 23153;
+	cal.ac5 = 32757;
+	cal.mc = -8711;
+	cal.md = 2868;
 #endif
 
 	B5 = computeB5(UT);
@@ -225,65 +341,119 @@ float Adafruit_BMP085::readTemperature(void) {
 }
 
 float Adafruit_BMP085::readAltitude(float sealevelPressure) {
-	return 0;
-	// disabled so it doesnt pull in math libs
-	//float altitude;
-	//float pressure = readPressure();
-	//altitude = 44330 * (1.0 - pow(pressure / sealevelPressure, 0.1903));
-	//return altitude;
+	// the pow() version pulled in the math libs, the tables below don't
+	return pressureToAltitude(readPressure(), (int32_t)sealevelPressure) / 100.0f;
 }
 
-
 /*********************************************************************/
 
-uint8_t Adafruit_BMP085::read8(uint8_t a) {
-	uint8_t ret;
+// 44330 * (1 - (p/p0)^0.1903) in cm for p/p0 = 0.25 .. 1.25 in steps of 1/128.
+// Linear interpolation error against pow() is under 11 cm above 70 kPa and under 50 cm at 30 kPa.
+#define BMP085_ALT_STEPS 128
+#define BMP085_ALT_MIN (1L << 21)            // 0.25 in Q23
+#define BMP085_ALT_MAX (5L << 21)            // 1.25 in Q23
+#define BMP085_ALT_SHIFT 16                  // Q23 step of 1/128
 
-	Wire.beginTransmission(BMP085_I2CADDR); // start transmission to device 
-#if (ARDUINO >= 100)
-	Wire.write(a); // sends register address to read from
-#else
-	Wire.send(a); // sends register address to read from
-#endif
-	Wire.endTransmission(); // end transmission
+struct Bmp085AltitudeGen {
+	static constexpr int32_t value(int i) {
+		return cxRound(4433000.0 * (1.0 - cxPow(0.25 + i / (double)BMP085_ALT_STEPS, 0.1903)));
+	}
+};
 
-	Wire.beginTransmission(BMP085_I2CADDR); // start transmission to device 
-	Wire.requestFrom(BMP085_I2CADDR, 1);// send data n-bytes read
-#if (ARDUINO >= 100)
-	ret = Wire.read(); // receive DATA
-#else
-	ret = Wire.receive(); // receive DATA
-#endif
-	Wire.endTransmission(); // end transmission
+typedef ConstTable<int32_t, Bmp085AltitudeGen, MakeIndexList<BMP085_ALT_STEPS + 1>::type> Bmp085AltitudeTable;
+
+// (1 - h/44330)^-5.255 in Q28 for h = -655.36 m .. 9830.4 m in steps of 81.92 m.
+// Interpolation error against pow() is under 3 Pa on the sea level pressure, altitudes outside the table are clamped.
+#define BMP085_SL_STEPS 128
+#define BMP085_SL_MIN (-65536L)              // cm
+#define BMP085_SL_SHIFT 13                   // 8192 cm per step
+
+struct Bmp085SealevelGen {
+	static constexpr int32_t value(int i) {
+		return cxRound(268435456.0 * cxPow(1.0 - (BMP085_SL_MIN + i * (double)(1L << BMP085_SL_SHIFT)) / 4433000.0, -5.255));
+	}
+};
+
+typedef ConstTable<int32_t, Bmp085SealevelGen, MakeIndexList<BMP085_SL_STEPS + 1>::type> Bmp085SealevelTable;
+
+int32_t Adafruit_BMP085::pressureToAltitude(int32_t pressure, int32_t sealevelPressure) {
+	if ((pressure <= 0) || (sealevelPressure <= 0))
+		return 0;
+	if (pressure > 131071)
+		pressure = 131071;
+
+	// p/p0 in Q23 with 32 bit division, the remainder supplies the low 8 bits
+	uint32_t num = (uint32_t)pressure << 15;
+	uint32_t q = num / sealevelPressure;
+	uint32_t rem = num % sealevelPressure;
+	uint32_t ratio = (q << 8) | ((rem << 8) / sealevelPressure);
+
+	if (ratio < BMP085_ALT_MIN)
+		ratio = BMP085_ALT_MIN;
+	if (ratio >= BMP085_ALT_MAX)
+		ratio = BMP085_ALT_MAX - 1;
+
+	uint32_t x = ratio - BMP085_ALT_MIN;
+	uint32_t i = x >> BMP085_ALT_SHIFT;
+	int32_t frac = x & ((1L << BMP085_ALT_SHIFT) - 1);
+
+	const int32_t *t = Bmp085AltitudeTable::values;
+	return t[i] + (((t[i + 1] - t[i]) * frac) >> BMP085_ALT_SHIFT);
+}
 
+int32_t Adafruit_BMP085::altitudeToSealevel(int32_t pressure, int32_t altitude) {
+	int32_t x = altitude - BMP085_SL_MIN;
+	if (x < 0)
+		x = 0;
+	if (x >= (BMP085_SL_STEPS << BMP085_SL_SHIFT))
+		x = (BMP085_SL_STEPS << BMP085_SL_SHIFT) - 1;
+
+	uint32_t i = x >> BMP085_SL_SHIFT;
+	int32_t frac = x & ((1L << BMP085_SL_SHIFT) - 1);
+
+	const int32_t *t = Bmp085SealevelTable::values;
+	int32_t factor = t[i] + (int32_t)(((int64_t)(t[i + 1] - t[i]) * frac) >> BMP085_SL_SHIFT);
+
+	return (int32_t)(((int64_t)pressure * factor + (1L << 27)) >> 28);
+}
+
+
+/*********************************************************************/
+
+uint8_t Adafruit_BMP085::read8(uint8_t a) {
+	uint8_t ret;
+	readBytes(a, &ret, 1);
 	return ret;
 }
 
 uint16_t Adafruit_BMP085::read16(uint8_t a) {
-	uint16_t ret;
+	uint8_t buf[2];
+	readBytes(a, buf, 2);
+	return ((uint16_t)buf[0] << 8) | buf[1];
+}
 
+// register pointer write and the read share one transaction via a repeated start,
+// the chip auto-increments the address so len registers come back in one go
+void Adafruit_BMP085::readBytes(uint8_t a, uint8_t *buf, uint8_t len) {
 	Wire.beginTransmission(BMP085_I2CADDR); // start transmission to device 
 #if (ARDUINO >= 100)
 	Wire.write(a); // sends register address to read from
+	Wire.endTransmission(false); // repeated start, keep the bus
 #else
 	Wire.send(a); // sends register address to read from
-#endif
 	Wire.endTransmission(); // end transmission
+	transactions++;
+#endif
 
-	Wire.beginTransmission(BMP085_I2CADDR); // start transmission to device 
-	Wire.requestFrom(BMP085_I2CADDR, 2);// send data n-bytes read
+	Wire.requestFrom(BMP085_I2CADDR, (int)len);// send data n-bytes read
+	for (uint8_t i = 0; i < len; i++) {
 #if (ARDUINO >= 100)
-	ret = Wire.read(); // receive DATA
-	ret <<= 8;
-	ret |= Wire.read(); // receive DATA
+		buf[i] = Wire.read(); // receive DATA
 #else
-	ret = Wire.receive(); // receive DATA
-	ret <<= 8;
-	ret |= Wire.receive(); // receive DATA
+		buf[i] = Wire.receive(); // receive DATA
 #endif
-	Wire.endTransmission(); // end transmission
-
-	return ret;
+	}
+	transactions++;
 }
 
 void Adafruit_BMP085::write8(uint8_t a, uint8_t d) {
@@ -296,4 +466,5 @@ void Adafruit_BMP085::write8(uint8_t a, uint8_t d) {
 	Wire.send(d);  // write data
 #endif
 	Wire.endTransmission(); // end transmission
+	transactions++;
 }
@@ -49,28 +49,86 @@ BSD license, all text above must be included in any redistribution
 #define BMP085_READTEMPCMD          0x2E
 #define BMP085_READPRESSURECMD            0x34
 
+#define BMP085_IDLE          0
+#define BMP085_TEMPERATURE   1
+#define BMP085_PRESSURE      2
+
+// factory calibration, 0xAA-0xBF
+struct Bmp085Calibration {
+	int16_t ac1, ac2, ac3;
+	uint16_t ac4, ac5, ac6;
+	int16_t b1, b2, mb, mc, md;
+};
+
+// datasheet compensation over n raw samples, for reprocessing logged UT/UP counts.
+// Temperature in 0.1 C, pressure in Pa. Separate arrays and no branches in the loop
+// so a host compiler can pipeline or vectorize it.
+void bmp085Compensate(const Bmp085Calibration *cal, uint8_t oversampling,
+	const int32_t *ut, const int32_t *up, int32_t *temperature, int32_t *pressure, size_t n);
 
 class Adafruit_BMP085 {
 public:
 	Adafruit_BMP085();
 	boolean begin(uint8_t mode = BMP085_ULTRAHIGHRES);  // by default go highres
+	// begin() with calibration saved from an earlier begin(), only the chip ID is read
+	boolean begin(const Bmp085Calibration &stored, uint8_t mode = BMP085_ULTRAHIGHRES);
+	void setOversampling(uint8_t mode);
 	float readTemperature(void);
 	int32_t readPressure(void);
 	int32_t readSealevelPressure(float altitude_meters = 0);
 	float readAltitude(float sealevelPressure = 101325); // std atmosphere
+
+	// table driven barometric formula, no libm. Altitude in cm, pressures in Pa
+	static int32_t pressureToAltitude(int32_t pressure, int32_t sealevelPressure = 101325);
+	static int32_t altitudeToSealevel(int32_t pressure, int32_t altitude);
 	uint16_t readRawTemperature(void);
 	uint32_t readRawPressure(void);
 
+	// split phase conversions, start one, do something useful until isReady() and then collect()
+	void startTemperature(void);
+	void startPressure(void);
+	boolean isReady(void);
+	uint8_t collect(void);  // BMP085_TEMPERATURE or BMP085_PRESSURE for what was read, BMP085_IDLE if nothing
+	float getTemperature(void);  // from the last collected temperature
+	int32_t getPressure(void);   // from the last collected temperature and pressure
+
+	// temperature compensation (B5) is reused until every pressure samples have been taken or
+	// interval ms have passed, whichever comes first. 0 disables that limit, the default of
+	// every = 1 refreshes it for each pressure like readPressure() does
+	void setTemperatureRefresh(uint8_t every, uint32_t interval = 0);
+	boolean temperatureDue(void);
+	// temperature and pressure from one call, only converting temperature when it's due
+	void readTemperatureAndPressure(float *temperature, int32_t *pressure);
+
+	// coefficients read by begin(), e.g. to log alongside raw counts for bmp085Compensate()
+	const Bmp085Calibration &getCalibration(void) const { return cal; }
+	void setCalibration(const Bmp085Calibration &c) { cal = c; }
+
+	uint32_t transactions;  // I2C bus transactions so far, to measure bus time
+
 private:
 	int32_t computeB5(int32_t UT);
+	int32_t computePressure(int32_t B5, int32_t UP);
 	uint8_t read8(uint8_t addr);
 	uint16_t read16(uint8_t addr);
+	void readBytes(uint8_t addr, uint8_t *buf, uint8_t len);
 	void write8(uint8_t addr, uint8_t data);
 
 	uint8_t oversampling;
 
-	int16_t ac1, ac2, ac3, b1, b2, mb, mc, md;
-	uint16_t ac4, ac5, ac6;
+	uint8_t conversion;       // BMP085_TEMPERATURE, BMP085_PRESSURE or BMP085_IDLE
+	uint32_t conversionStart; // millis()
+	uint8_t conversionTime;   // ms
+	int32_t lastUT, lastUP;
+
+	int32_t cachedB5;         // from lastUT
+	boolean b5Valid;
+	uint8_t refreshEvery;
+	uint32_t refreshInterval;
+	uint8_t pressureCount;    // pressure samples since the last temperature
+	uint32_t temperatureTime; // millis() of the last temperature
+
+	Bmp085Calibration cal;
 };
 
 
@@ -0,0 +1,38 @@
+// 
+// 
+// 
+
+#include "devicestate.h"
+
+static_assert((sizeof(DeviceState) & 3) == 0, "RTC memory is read and written in whole blocks");
+
+static uint32_t deviceStateCrc(const DeviceState& state)
+{
+	const byte* p = (const byte*)&state;
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (uint16_t i = 0; i < offsetof(DeviceState, crc); i++)
+	{
+		crc ^= p[i];
+		for (byte b = 0; b < 8; b++)
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+	}
+	return ~crc;
+}
+
+bool loadDeviceState(DeviceState& state)
+{
+	if (ESP.rtcUserMemoryRead(DEVICE_STATE_RTC_BLOCK, (uint32_t*)&state, sizeof(state)) &&
+		(state.magic == DEVICE_STATE_MAGIC) && (state.crc == deviceStateCrc(state)))
+		return true;
+
+	memset(&state, 0, sizeof(state));
+	return false;
+}
+
+void saveDeviceState(DeviceState& state)
+{
+	state.magic = DEVICE_STATE_MAGIC;
+	state.crc = deviceStateCrc(state);
+	ESP.rtcUserMemoryWrite(DEVICE_STATE_RTC_BLOCK, (uint32_t*)&state, sizeof(state));
+}
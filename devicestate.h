@@ -0,0 +1,36 @@
+// devicestate.h
+
+#ifndef _DEVICESTATE_h
+#define _DEVICESTATE_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "bmp085.h"
+
+#define DEVICE_STATE_RTC_BLOCK 32	// RTC user memory is addressed in 4 byte blocks, OTA uses the first 32
+#define DEVICE_STATE_MAGIC 0x53544431
+
+// Sensor setup kept in RTC memory across deep sleep. RTC memory goes with the supply,
+// and so does the sensors' register state, so a valid blob means the sensors still hold
+// what was programmed into them and only need an ID check.
+struct DeviceState
+{
+	uint32_t magic;
+	byte bmaId;			// BMA180 chip id and version when it was programmed
+	byte bmaVersion;
+	byte bmaFilter;		// BMA180::FILTER
+	byte bmaRange;		// BMA180::GSENSITIVITY
+	Bmp085Calibration bmp;
+	uint32_t crc;		// over everything above
+};
+
+// Returns false and clears state if there's nothing valid, i.e. after a power on or a flash
+bool loadDeviceState(DeviceState& state);
+void saveDeviceState(DeviceState& state);
+
+#endif
+
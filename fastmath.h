@@ -0,0 +1,102 @@
+// fastmath.h
+
+#ifndef _FASTMATH_h
+#define _FASTMATH_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+// Compile time only maths for building lookup tables, none of this ends up in the firmware.
+// Plain series, good to double precision over the ranges the tables use.
+
+constexpr double cxExpSeries(double x, double term, int n)
+{
+	return (n > 40) ? term : term + cxExpSeries(x, term * x / n, n + 1);
+}
+
+// e^x, |x| < 3 or so
+constexpr double cxExp(double x)
+{
+	return cxExpSeries(x, 1.0, 1);
+}
+
+constexpr double cxLnSeries(double z2, double zpow, int k)
+{
+	return (k > 80) ? 0 : zpow / (2 * k + 1) + cxLnSeries(z2, zpow * z2, k + 1);
+}
+
+constexpr double cxLnZ(double z)
+{
+	return 2 * cxLnSeries(z * z, z, 0);
+}
+
+// ln(x) via 2 atanh((x-1)/(x+1)), x roughly 0.1..10
+constexpr double cxLn(double x)
+{
+	return cxLnZ((x - 1) / (x + 1));
+}
+
+constexpr double cxPow(double x, double y)
+{
+	return cxExp(y * cxLn(x));
+}
+
+#define CX_PI 3.14159265358979323846
+
+constexpr double cxSinSeries(double x2, double term, int n)
+{
+	return (n > 40) ? term : term + cxSinSeries(x2, -term * x2 / ((n + 1) * (n + 2)), n + 2);
+}
+
+// sin(x), any x, folded into -pi..pi first
+constexpr double cxSinReduced(double x)
+{
+	return (x > CX_PI) ? cxSinReduced(x - 2 * CX_PI) : (x < -CX_PI) ? cxSinReduced(x + 2 * CX_PI) : cxSinSeries(x * x, x, 1);
+}
+
+constexpr double cxSin(double x)
+{
+	return cxSinReduced(x);
+}
+
+constexpr double cxCos(double x)
+{
+	return cxSinReduced(x + CX_PI / 2);
+}
+
+constexpr int32_t cxRound(double x)
+{
+	return (x < 0) ? (int32_t)(x - 0.5) : (int32_t)(x + 0.5);
+}
+
+// Expands GEN::value(0) .. GEN::value(N-1) into a const table at compile time, e.g.
+//   ConstTable<int32_t, AltitudeGen, MakeIndexList<129>::type>::values
+template <int... I>
+struct IndexList {};
+
+template <int N, int... I>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+
+template <int... I>
+struct MakeIndexList<0, I...>
+{
+	typedef IndexList<I...> type;
+};
+
+template <typename T, typename GEN, typename LIST>
+struct ConstTable;
+
+template <typename T, typename GEN, int... I>
+struct ConstTable<T, GEN, IndexList<I...> >
+{
+	static const T values[sizeof...(I)];
+};
+
+template <typename T, typename GEN, int... I>
+const T ConstTable<T, GEN, IndexList<I...> >::values[sizeof...(I)] = { GEN::value(I)... };
+
+#endif
+
@@ -0,0 +1,111 @@
+// 
+// 
+// 
+
+#include "forecast.h"
+
+PressureHistory::PressureHistory()
+{
+	clear();
+}
+
+void PressureHistory::clear()
+{
+	slots = 0;
+	sum = 0;
+	minimums.clear();
+	maximums.clear();
+	slotCount = 0;
+	slotSum = 0;
+}
+
+void PressureHistory::update(uint32_t now, int32_t pressure)
+{
+	//slots follow each other back to back, a new run starts with the first reading or after a gap
+	if ((slotCount == 0) && ((slots == 0) || (now - slotStart >= PRESSURE_HISTORY_INTERVAL)))
+		slotStart = now;
+
+	slotSum += pressure;
+	slotCount++;
+
+	if (now - slotStart < PRESSURE_HISTORY_INTERVAL)
+		return;
+
+	push((int32_t)((slotSum + slotCount / 2) / slotCount));
+	slotSum = 0;
+	slotCount = 0;
+	slotStart += PRESSURE_HISTORY_INTERVAL;
+}
+
+void PressureHistory::push(int32_t pressure)
+{
+	uint16_t i = slots % PRESSURE_HISTORY_SIZE;
+
+	//the slot being overwritten drops out of the window
+	if (isFull())
+		sum -= history[i];
+	history[i] = pressure;
+	sum += pressure;
+
+	minimums.push(slots, pressure);
+	maximums.push(slots, pressure);
+	slots++;
+}
+
+int32_t PressureHistory::mean() const
+{
+	uint16_t n = count();
+	if (n == 0)
+		return 0;
+	return (sum + n / 2) / n;
+}
+
+int32_t PressureHistory::tendency() const
+{
+	if (slots == 0)
+		return 0;
+
+	//the oldest slot is the next one to be overwritten once full
+	uint16_t newest = (slots - 1) % PRESSURE_HISTORY_SIZE;
+	uint16_t oldest = isFull() ? slots % PRESSURE_HISTORY_SIZE : 0;
+	return history[newest] - history[oldest];
+}
+
+byte PressureHistory::forecast(int32_t sealevelPressure) const
+{
+	if (!isFull())
+		return 0;
+
+	//the usual straight line fits to the Zambretti tables, with p in hPa:
+	//falling 127 - 0.12p, steady 144 - 0.13p, rising 185 - 0.16p
+	int32_t t = tendency();
+	int32_t z;
+	byte lo, hi;
+
+	if (t <= -PRESSURE_STEADY)
+	{
+		z = 1270000L - 12 * sealevelPressure;
+		lo = 1;
+		hi = 9;
+	}
+	else if (t >= PRESSURE_STEADY)
+	{
+		z = 1850000L - 16 * sealevelPressure;
+		lo = 20;
+		hi = 32;
+	}
+	else
+	{
+		z = 1440000L - 13 * sealevelPressure;
+		lo = 10;
+		hi = 19;
+	}
+
+	//z is in 1e-4, round and keep it inside the band for the tendency
+	z = (z + 5000) / 10000;
+	if (z < lo)
+		return lo;
+	if (z > hi)
+		return hi;
+	return (byte)z;
+}
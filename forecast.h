@@ -0,0 +1,106 @@
+// forecast.h
+
+#ifndef _FORECAST_h
+#define _FORECAST_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#define PRESSURE_HISTORY_INTERVAL 600000UL	// ms per history slot, readings in a slot are averaged
+#define PRESSURE_TENDENCY_PERIOD 10800000UL	// ms, the 3 hour window the tendency and extremes cover
+#define PRESSURE_HISTORY_SIZE (PRESSURE_TENDENCY_PERIOD / PRESSURE_HISTORY_INTERVAL + 1)	// slots, both ends of the window
+#define PRESSURE_STEADY 160				// Pa, a 3 hour change under this is steady
+
+// Minimum or maximum (MAX) of the last SIZE samples in O(1) amortized time. Only samples that
+// could still become the extreme are queued, so the queue is monotonic and the extreme is at the front.
+template <uint16_t SIZE, bool MAX>
+class WindowExtreme
+{
+public:
+	WindowExtreme() { clear(); }
+
+	void clear()
+	{
+		head = 0;
+		len = 0;
+	}
+
+	void push(uint32_t seq, int32_t value)
+	{
+		//the front leaves the window
+		if (len && (seq - seqs[head] >= SIZE))
+		{
+			head = (head + 1) % SIZE;
+			len--;
+		}
+
+		//anything not better than the new value can never be the extreme again
+		while (len)
+		{
+			int32_t last = values[(head + len - 1) % SIZE];
+			if (MAX ? (last > value) : (last < value))
+				break;
+			len--;
+		}
+
+		uint16_t i = (head + len) % SIZE;
+		seqs[i] = seq;
+		values[i] = value;
+		len++;
+	}
+
+	int32_t get() const { return len ? values[head] : 0; }
+
+private:
+	uint32_t seqs[SIZE];
+	int32_t values[SIZE];
+	uint16_t head;
+	uint16_t len;
+};
+
+// Station pressure history in a fixed ring of PRESSURE_HISTORY_SIZE slots, with the window's
+// min, max, mean and tendency kept up to date as slots are added rather than rescanned.
+class PressureHistory
+{
+public:
+	PressureHistory();
+
+	void clear();
+
+	// Feed every pressure reading, Pa
+	void update(uint32_t now, int32_t pressure);
+
+	// True once the history spans the whole tendency period
+	bool isFull() const { return slots >= PRESSURE_HISTORY_SIZE; }
+	uint16_t count() const { return slots < PRESSURE_HISTORY_SIZE ? slots : PRESSURE_HISTORY_SIZE; }
+
+	// Over the slots held, Pa. Tendency is newest minus oldest.
+	int32_t minimum() const { return minimums.get(); }
+	int32_t maximum() const { return maximums.get(); }
+	int32_t mean() const;
+	int32_t tendency() const;
+
+	// Zambretti forecast number, 1..9 falling, 10..19 steady, 20..32 rising, lower is
+	// better weather. Needs the sea level pressure, 0 until the history is full.
+	byte forecast(int32_t sealevelPressure) const;
+
+private:
+	void push(int32_t pressure);
+
+	int32_t history[PRESSURE_HISTORY_SIZE];
+	uint32_t slots;		// slots pushed since clear(), the sequence number of the next one
+	int32_t sum;		// of the slots held
+
+	WindowExtreme<PRESSURE_HISTORY_SIZE, false> minimums;
+	WindowExtreme<PRESSURE_HISTORY_SIZE, true> maximums;
+
+	uint32_t slotStart;	// millis() the current slot opened
+	int64_t slotSum;	// readings in the current slot
+	uint16_t slotCount;
+};
+
+#endif
+
@@ -0,0 +1,20 @@
+//
+//
+//
+
+#include "gpsfix.h"
+
+uint32_t gpsEpoch(uint16_t year, byte month, byte day, byte hour, byte minute, byte second)
+{
+	//days from civil, shifted so the year starts in March and Feb 29 falls at the end
+	int32_t y = year;
+	if (month <= 2)
+		y--;
+	int32_t era = y / 400;
+	int32_t yoe = y - era * 400;
+	int32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	int32_t days = era * 146097 + doe - 719468;
+
+	return (uint32_t)days * 86400UL + hour * 3600UL + minute * 60UL + second;
+}
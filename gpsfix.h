@@ -0,0 +1,34 @@
+// gpsfix.h
+
+#ifndef _GPSFIX_h
+#define _GPSFIX_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+// Latest position fix, filled in place by whichever decoder is running
+struct GpsFix
+{
+	int32_t lat;		// 1e-7 degrees, north positive
+	int32_t lon;		// 1e-7 degrees, east positive
+	uint32_t time;		// UTC seconds since 1970-01-01
+	int32_t altitude;	// above mean sea level, cm
+	uint16_t speed;		// ground speed cm/s
+	uint16_t course;	// course over ground, 0.01 degrees
+	uint16_t hdop;		// 0.01
+	uint16_t pdop;		// 0.01
+	byte quality;		// GGA fix quality, 0 = none, 1 = GPS, 2 = DGPS
+	byte fixMode;		// 1 = none, 2 = 2D, 3 = 3D
+	byte satellites;	// used in the solution
+	byte satellitesInView;	// over all constellations
+	bool valid;
+};
+
+// Seconds since 1970-01-01 for a UTC calendar date, no libc time functions needed
+uint32_t gpsEpoch(uint16_t year, byte month, byte day, byte hour, byte minute, byte second);
+
+#endif
+
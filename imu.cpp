@@ -4,6 +4,7 @@
 
 #include "imu.h"
 #include <math.h>
+#include "trig.h"
 #include <Wire.h>
 
 // Sensor calibration scale and offset values
@@ -172,12 +173,10 @@ void Matrix_Vector_Multiply(const float a[3][3], const float b[3], float out[3])
 // Init rotation matrix using euler angles
 void init_rotation_matrix(float m[3][3], float yaw, float pitch, float roll)
 {
-	float c1 = cos(roll);
-	float s1 = sin(roll);
-	float c2 = cos(pitch);
-	float s2 = sin(pitch);
-	float c3 = cos(yaw);
-	float s3 = sin(yaw);
+	float c1, s1, c2, s2, c3, s3;
+	fastSinCosf(roll, &s1, &c1);
+	fastSinCosf(pitch, &s2, &c2);
+	fastSinCosf(yaw, &s3, &c3);
 
 	// Euler angles, right-handed, intrinsic, XYZ convention
 	// (which means: rotate around body axes Z, Y', X'') 
@@ -254,8 +253,7 @@ void Drift_correction(void)
 	//*****YAW***************
 	// We make the gyro YAW drift correction based on compass magnetic heading
 
-	mag_heading_x = cos(MAG_Heading);
-	mag_heading_y = sin(MAG_Heading);
+	fastSinCosf(MAG_Heading, &mag_heading_y, &mag_heading_x);
 	errorCourse = (DCM_Matrix[0][0] * mag_heading_y) - (DCM_Matrix[1][0] * mag_heading_x);  //Calculating YAW error
 	Vector_Scale(errorYaw, &DCM_Matrix[2][0], errorCourse); //Applys the yaw correction to the XYZ rotation of the aircraft, depeding the position.
 
@@ -314,9 +312,9 @@ void Matrix_update(void)
 
 void Euler_angles(void)
 {
-	pitch = -asin(DCM_Matrix[2][0]);
-	roll = atan2(DCM_Matrix[2][1], DCM_Matrix[2][2]);
-	yaw = atan2(DCM_Matrix[1][0], DCM_Matrix[0][0]);
+	pitch = -fastAsinf(DCM_Matrix[2][0]);
+	roll = fastAtan2f(DCM_Matrix[2][1], DCM_Matrix[2][2]);
+	yaw = fastAtan2f(DCM_Matrix[1][0], DCM_Matrix[0][0]);
 }
 
 
@@ -519,17 +517,15 @@ void Compass_Heading()
 	float cos_pitch;
 	float sin_pitch;
 
-	cos_roll = cos(roll);
-	sin_roll = sin(roll);
-	cos_pitch = cos(pitch);
-	sin_pitch = sin(pitch);
+	fastSinCosf(roll, &sin_roll, &cos_roll);
+	fastSinCosf(pitch, &sin_pitch, &cos_pitch);
 
 	// Tilt compensated magnetic field X
 	mag_x = magnetom[0] * cos_pitch + magnetom[1] * sin_roll * sin_pitch + magnetom[2] * cos_roll * sin_pitch;
 	// Tilt compensated magnetic field Y
 	mag_y = magnetom[1] * cos_roll - magnetom[2] * sin_roll;
 	// Magnetic Heading
-	MAG_Heading = atan2(-mag_y, mag_x);
+	MAG_Heading = fastAtan2f(-mag_y, mag_x);
 }
 
 
@@ -850,7 +846,7 @@ void reset_sensor_fusion() {
 
 	// GET PITCH
 	// Using y-z-plane-component/x-component of gravity vector
-	pitch = -atan2(accel[0], sqrt(accel[1] * accel[1] + accel[2] * accel[2]));
+	pitch = -fastAtan2f(accel[0], sqrtf(accel[1] * accel[1] + accel[2] * accel[2]));
 
 	// GET ROLL
 	// Compensate pitch of gravity vector 
@@ -859,7 +855,7 @@ void reset_sensor_fusion() {
 	// Normally using x-z-plane-component/y-component of compensated gravity vector
 	// roll = atan2(temp2[1], sqrt(temp2[0] * temp2[0] + temp2[2] * temp2[2]));
 	// Since we compensated for pitch, x-z-plane-component equals z-component:
-	roll = atan2(temp2[1], temp2[2]);
+	roll = fastAtan2f(temp2[1], temp2[2]);
 
 	// GET YAW
 	Compass_Heading();
@@ -0,0 +1,208 @@
+// median.h
+
+#ifndef _MEDIAN_h
+#define _MEDIAN_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#define HAMPEL_MAD_SCALE 1518	// 1.4826 in Q10, turns the MAD into a standard deviation for normal noise
+
+// Median of the last SIZE samples in O(log SIZE) per sample, no sorting. The window is a
+// circular queue and the heap holds indexes into it: a max heap of the lower half at negative
+// positions, the median at 0 and a min heap of the upper half at positive positions.
+// A new sample replaces the oldest in place and is sifted within its half, crossing the
+// median at most once. After ashelly's Mediator.
+template <uint16_t SIZE>
+class RunningMedian
+{
+public:
+	RunningMedian() { clear(); }
+
+	void clear()
+	{
+		idx = 0;
+		minCt = 0;
+		maxCt = 0;
+
+		//fill pattern median, max, min, max, min...
+		for (int16_t i = 0; i < SIZE; i++)
+		{
+			pos[i] = ((i + 1) / 2) * ((i & 1) ? -1 : 1);
+			heap(pos[i]) = i;
+		}
+	}
+
+	void push(int32_t v)
+	{
+		int16_t p = pos[idx];
+		int32_t old = data[idx];
+		data[idx] = v;
+		if (++idx == SIZE)
+			idx = 0;
+
+		if (p > 0)
+		{
+			//upper half
+			if (minCt < (SIZE - 1) / 2)
+				minCt++;
+			else if (old < v)
+			{
+				minSortDown(p);
+				return;
+			}
+			if (minSortUp(p) && swapIfLess(0, -1))
+				maxSortDown(-1);
+		}
+		else if (p < 0)
+		{
+			//lower half
+			if (maxCt < SIZE / 2)
+				maxCt++;
+			else if (v < old)
+			{
+				maxSortDown(p);
+				return;
+			}
+			if (maxSortUp(p) && minCt && swapIfLess(1, 0))
+				minSortDown(1);
+		}
+		else
+		{
+			//replaced the median itself
+			if (maxCt && maxSortUp(-1))
+				maxSortDown(-1);
+			if (minCt && minSortUp(1))
+				minSortDown(1);
+		}
+	}
+
+	// Middle value, the mean of the middle two while an even number of samples is held
+	int32_t median() const
+	{
+		int32_t v = data[heap(0)];
+		if (minCt < maxCt)
+			v = (v + data[heap(-1)]) / 2;
+		return v;
+	}
+
+	uint16_t count() const { return minCt + maxCt + 1; }
+
+private:
+	int16_t& heap(int16_t i) { return heapBuf[i + SIZE / 2]; }
+	int16_t heap(int16_t i) const { return heapBuf[i + SIZE / 2]; }
+
+	bool less(int16_t i, int16_t j) const { return data[heap(i)] < data[heap(j)]; }
+
+	bool swapIfLess(int16_t i, int16_t j)
+	{
+		if (!less(i, j))
+			return false;
+		int16_t t = heap(i);
+		heap(i) = heap(j);
+		heap(j) = t;
+		pos[heap(i)] = i;
+		pos[heap(j)] = j;
+		return true;
+	}
+
+	void minSortDown(int16_t i)
+	{
+		for (i *= 2; i <= minCt; i *= 2)
+		{
+			if ((i < minCt) && less(i + 1, i))
+				i++;
+			if (!swapIfLess(i, i / 2))
+				break;
+		}
+	}
+
+	void maxSortDown(int16_t i)
+	{
+		for (i *= 2; i >= -maxCt; i *= 2)
+		{
+			if ((i > -maxCt) && less(i, i - 1))
+				i--;
+			if (!swapIfLess(i / 2, i))
+				break;
+		}
+	}
+
+	//true if it went all the way to the median
+	bool minSortUp(int16_t i)
+	{
+		while ((i > 0) && swapIfLess(i, i / 2))
+			i /= 2;
+		return i == 0;
+	}
+
+	bool maxSortUp(int16_t i)
+	{
+		while ((i < 0) && swapIfLess(i / 2, i))
+			i /= 2;
+		return i == 0;
+	}
+
+	static_assert((SIZE & 1) == 1, "RunningMedian SIZE must be odd");
+
+	int32_t data[SIZE];		// circular queue of samples
+	int16_t pos[SIZE];		// heap position of each sample
+	int16_t heapBuf[SIZE];	// sample indexes, heap(0) is the median
+	uint16_t idx;			// next sample to replace
+	uint16_t minCt;			// samples in the upper half
+	uint16_t maxCt;			// samples in the lower half
+};
+
+// Sliding median with a Hampel test: a sample further than sigmas * 1.4826 * MAD from the
+// window median is an outlier and the median is returned in its place. The MAD is the running
+// median of each sample's deviation from the median at the time it arrived, which keeps the
+// update O(log SIZE) instead of recomputing every deviation when the median moves.
+template <uint16_t SIZE>
+class HampelFilter
+{
+public:
+	// minDeviation stops a flat signal (MAD 0) from flagging every small step
+	HampelFilter(byte sigmas = 3, int32_t minDeviation = 1) : outliers(0), sigmas(sigmas), minDeviation(minDeviation) {}
+
+	void clear()
+	{
+		values.clear();
+		deviations.clear();
+	}
+
+	int32_t update(int32_t x)
+	{
+		values.push(x);
+		int32_t med = values.median();
+		int32_t dev = (x > med) ? x - med : med - x;
+		deviations.push(dev);
+
+		//wait for a full window before judging anything
+		if (values.count() < SIZE)
+			return x;
+
+		int32_t limit = (int32_t)(((int64_t)deviations.median() * HAMPEL_MAD_SCALE * sigmas) >> 10);
+		if ((dev > limit) && (dev > minDeviation))
+		{
+			outliers++;
+			return med;
+		}
+		return x;
+	}
+
+	int32_t median() const { return values.median(); }
+
+	uint16_t outliers;	// samples replaced by the median
+
+private:
+	RunningMedian<SIZE> values;
+	RunningMedian<SIZE> deviations;
+	byte sigmas;
+	int32_t minDeviation;
+};
+
+#endif
+
@@ -0,0 +1,330 @@
+// 
+// 
+// 
+
+#include "nmea.h"
+
+static byte hexValue(char c)
+{
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+	return 0xFF;
+}
+
+// Parses a decimal field into an integer scaled by 10^decimals, extra digits are truncated
+static int32_t parseFixed(const char* s, byte decimals)
+{
+	int32_t v = 0;
+	bool frac = false;
+	bool neg = (*s == '-');
+	while (*s)
+	{
+		char c = *s++;
+		if (c == '.')
+		{
+			frac = true;
+		}
+		else if ((c >= '0') && (c <= '9'))
+		{
+			if (frac)
+			{
+				if (decimals == 0)
+					break;
+				decimals--;
+			}
+			v = v * 10 + (c - '0');
+		}
+	}
+	while (decimals--)
+		v *= 10;
+	return neg ? -v : v;
+}
+
+// ddmm.mmmmm into 1e-7 degrees
+static int32_t parseDegrees(const char* s)
+{
+	int32_t v = parseFixed(s, 5);
+	int32_t deg = v / 10000000;
+	int32_t minE5 = v % 10000000;
+	return deg * 10000000 + (minE5 * 100 + 30) / 60;
+}
+
+static byte parseTwoDigits(const char* s)
+{
+	return (s[0] - '0') * 10 + (s[1] - '0');
+}
+
+// NMEA_TALKER_ bit for the first two characters of the address field
+static byte parseTalker(const char* s)
+{
+	if (s[0] == 'G')
+	{
+		switch (s[1])
+		{
+		case 'P': return NMEA_TALKER_GP;
+		case 'L': return NMEA_TALKER_GL;
+		case 'A': return NMEA_TALKER_GA;
+		case 'B': return NMEA_TALKER_GB;
+		case 'N': return NMEA_TALKER_GN;
+		}
+	}
+	else if ((s[0] == 'B') && (s[1] == 'D'))
+	{
+		return NMEA_TALKER_GB;
+	}
+	return NMEA_TALKER_OTHER;
+}
+
+static byte talkerIndex(byte talker)
+{
+	byte i = 0;
+	while ((talker >>= 1) != 0)
+		i++;
+	return i;
+}
+
+NmeaParser::NmeaParser()
+{
+	memset(&fix, 0, sizeof(fix));
+	sentences = 0;
+	errors = 0;
+	skipped = 0;
+	sentenceMask = NMEA_SENTENCE_MASK;
+	talkerMask = NMEA_TALKER_MASK;
+	memset(inView, 0, sizeof(inView));
+	reset();
+}
+
+void NmeaParser::reset()
+{
+	state = WAIT_START;
+	sentence = SENTENCE_UNKNOWN;
+	talker = 0;
+	gsvInView = 0;
+	checksum = 0;
+	fieldIndex = 0;
+	fieldLen = 0;
+	field[0] = 0;
+}
+
+bool NmeaParser::encode(char c)
+{
+	//a '$' always restarts, so a sentence cut off mid way just gets dropped
+	if (c == '$')
+	{
+		reset();
+		pending = fix;
+		timeOfDay = 0;
+		state = IN_FIELDS;
+		return false;
+	}
+
+	switch (state)
+	{
+	case WAIT_START:
+		break;
+
+	case IN_FIELDS:
+		if (c == '*')
+		{
+			endField();
+			state = CHECKSUM_HI;
+		}
+		else if ((c == '\r') || (c == '\n'))
+		{
+			//no checksum, not worth trusting
+			errors++;
+			state = WAIT_START;
+		}
+		else
+		{
+			checksum ^= c;
+			if (c == ',')
+			{
+				endField();
+			}
+			else if (fieldLen < NMEA_MAX_FIELD)
+			{
+				field[fieldLen++] = c;
+			}
+			else
+			{
+				errors++;
+				state = WAIT_START;
+			}
+		}
+		break;
+
+	case CHECKSUM_HI:
+		//a garbled digit would otherwise be read as 0xF0 or 0xFF and could still match
+		if (hexValue(c) > 0x0F)
+		{
+			errors++;
+			state = WAIT_START;
+			return false;
+		}
+		rxChecksum = hexValue(c) << 4;
+		state = CHECKSUM_LO;
+		break;
+
+	case CHECKSUM_LO:
+		state = WAIT_START;
+		if (hexValue(c) > 0x0F)
+		{
+			errors++;
+			return false;
+		}
+		rxChecksum |= hexValue(c);
+		if (rxChecksum != checksum)
+		{
+			errors++;
+			return false;
+		}
+		sentences++;
+		return endSentence();
+	}
+
+	return false;
+}
+
+void NmeaParser::endField()
+{
+	field[fieldLen] = 0;
+
+	if (fieldIndex == 0)
+	{
+		//GN/GP/GL etc all decode the same way, the talker only decides whether to
+		sentence = SENTENCE_UNKNOWN;
+		if (fieldLen == 5)
+		{
+			talker = parseTalker(field);
+			const char* id = field + 2;
+			if (strcmp(id, "RMC") == 0)
+				sentence = SENTENCE_RMC;
+			else if (strcmp(id, "GGA") == 0)
+				sentence = SENTENCE_GGA;
+			else if (strcmp(id, "GSA") == 0)
+				sentence = SENTENCE_GSA;
+			else if (strcmp(id, "GSV") == 0)
+				sentence = SENTENCE_GSV;
+			else if (strcmp(id, "VTG") == 0)
+				sentence = SENTENCE_VTG;
+		}
+
+		//stop buffering anything we aren't going to use until the next '$'
+		if (!((sentenceMask & sentence) && (talkerMask & talker)))
+		{
+			skipped++;
+			state = WAIT_START;
+		}
+	}
+	else
+	{
+		switch (sentence)
+		{
+		case SENTENCE_RMC: rmcField(); break;
+		case SENTENCE_GGA: ggaField(); break;
+		case SENTENCE_GSA: gsaField(); break;
+		case SENTENCE_GSV: gsvField(); break;
+		case SENTENCE_VTG: vtgField(); break;
+		default: break;
+		}
+	}
+
+	fieldIndex++;
+	fieldLen = 0;
+}
+
+void NmeaParser::rmcField()
+{
+	switch (fieldIndex)
+	{
+	case 1:
+		if (fieldLen >= 6)
+			timeOfDay = parseTwoDigits(field) * 3600UL + parseTwoDigits(field + 2) * 60UL + parseTwoDigits(field + 4);
+		break;
+	case 2: pending.valid = (field[0] == 'A'); break;
+	case 3: pending.lat = parseDegrees(field); break;
+	case 4: if (field[0] == 'S') pending.lat = -pending.lat; break;
+	case 5: pending.lon = parseDegrees(field); break;
+	case 6: if (field[0] == 'W') pending.lon = -pending.lon; break;
+	case 7: pending.speed = (parseFixed(field, 3) * 463 + 4500) / 9000; break; //knots to cm/s
+	case 8: pending.course = parseFixed(field, 2); break;
+	case 9:
+		if (fieldLen >= 6)
+			pending.time = gpsEpoch(2000 + parseTwoDigits(field + 4), parseTwoDigits(field + 2), parseTwoDigits(field), 0, 0, 0) + timeOfDay;
+		break;
+	}
+}
+
+void NmeaParser::ggaField()
+{
+	switch (fieldIndex)
+	{
+	case 6: pending.quality = parseFixed(field, 0); break;
+	case 7: pending.satellites = parseFixed(field, 0); break;
+	case 8: pending.hdop = parseFixed(field, 2); break;
+	case 9: pending.altitude = parseFixed(field, 2); break; //metres to cm
+	}
+}
+
+void NmeaParser::gsaField()
+{
+	switch (fieldIndex)
+	{
+	case 2: pending.fixMode = parseFixed(field, 0); break;
+	case 15: pending.pdop = parseFixed(field, 2); break;
+	}
+}
+
+void NmeaParser::gsvField()
+{
+	if (fieldIndex == 3)
+	{
+		int32_t n = parseFixed(field, 0);
+		gsvInView = (n > 0xFF) ? 0xFF : n;
+	}
+}
+
+byte NmeaParser::getSatellitesInView(byte t) const
+{
+	return inView[talkerIndex(t)];
+}
+
+void NmeaParser::vtgField()
+{
+	switch (fieldIndex)
+	{
+	case 1: pending.course = parseFixed(field, 2); break;
+	case 7: pending.speed = (parseFixed(field, 3) + 18) / 36; break; //km/h to cm/s
+	}
+}
+
+bool NmeaParser::endSentence()
+{
+	if ((sentence == SENTENCE_RMC) && (!pending.valid))
+	{
+		pending.lat = 0;
+		pending.lon = 0;
+		pending.time = 0;
+		pending.speed = 0;
+		pending.course = 0;
+	}
+
+	if (sentence == SENTENCE_GSV)
+	{
+		//GSV is sent per constellation, the fix gets them all
+		inView[talkerIndex(talker)] = gsvInView;
+		uint16_t total = 0;
+		for (byte i = 0; i < NMEA_TALKERS; i++)
+			total += inView[i];
+		pending.satellitesInView = (total > 0xFF) ? 0xFF : total;
+	}
+
+	fix = pending;
+	return sentence == SENTENCE_RMC;
+}
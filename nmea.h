@@ -0,0 +1,104 @@
+// nmea.h
+
+#ifndef _NMEA_h
+#define _NMEA_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "gpsfix.h"
+
+#define NMEA_MAX_FIELD 15 // longest field we keep, longer ones abandon the sentence
+
+#define NMEA_RMC 0x01
+#define NMEA_GGA 0x02
+#define NMEA_GSA 0x04
+#define NMEA_GSV 0x08
+#define NMEA_VTG 0x10
+
+#define NMEA_TALKER_GP 0x01	// GPS
+#define NMEA_TALKER_GL 0x02	// GLONASS
+#define NMEA_TALKER_GA 0x04	// Galileo
+#define NMEA_TALKER_GB 0x08	// BeiDou, also sent as BD
+#define NMEA_TALKER_GN 0x10	// combined solution from several constellations
+#define NMEA_TALKER_OTHER 0x20	// QZSS and anything else
+#define NMEA_TALKERS 6
+
+// Sentences and talkers decoded by default, everything else is skipped once its address field has been seen
+#ifndef NMEA_SENTENCE_MASK
+#define NMEA_SENTENCE_MASK (NMEA_RMC | NMEA_GGA | NMEA_GSA | NMEA_GSV | NMEA_VTG)
+#endif
+#ifndef NMEA_TALKER_MASK
+#define NMEA_TALKER_MASK (NMEA_TALKER_GP | NMEA_TALKER_GL | NMEA_TALKER_GA | NMEA_TALKER_GB | NMEA_TALKER_GN | NMEA_TALKER_OTHER)
+#endif
+
+// Byte-at-a-time NMEA 0183 parser. Keeps a single field in a fixed buffer,
+// checks the *hh checksum and only then commits the sentence to the fix.
+// Nothing here touches the heap.
+class NmeaParser
+{
+public:
+	NmeaParser();
+
+	// Feed one received byte, returns true when a checksummed RMC sentence has just been committed
+	bool encode(char c);
+	void reset();
+
+	const GpsFix& getFix() const { return fix; }
+
+	// Combination of NMEA_RMC, NMEA_GGA etc
+	void setSentenceMask(byte mask) { sentenceMask = mask; }
+	// Combination of NMEA_TALKER_GP, NMEA_TALKER_GL etc, a sentence has to pass both masks
+	void setTalkerMask(byte mask) { talkerMask = mask; }
+
+	// Satellites in view from one constellation's GSV, e.g. NMEA_TALKER_GL.
+	// The fix's satellitesInView is the sum over all of them.
+	byte getSatellitesInView(byte talker) const;
+
+	uint16_t sentences;	// sentences that passed the checksum
+	uint16_t errors;	// checksum failures and overlong fields
+	uint16_t skipped;	// unknown or masked out sentences
+
+private:
+	typedef enum { WAIT_START, IN_FIELDS, CHECKSUM_HI, CHECKSUM_LO } STATE;
+	typedef enum
+	{
+		SENTENCE_UNKNOWN = 0,
+		SENTENCE_RMC = NMEA_RMC,
+		SENTENCE_GGA = NMEA_GGA,
+		SENTENCE_GSA = NMEA_GSA,
+		SENTENCE_GSV = NMEA_GSV,
+		SENTENCE_VTG = NMEA_VTG
+	} SENTENCE;
+
+	void endField();
+	void rmcField();
+	void ggaField();
+	void gsaField();
+	void gsvField();
+	void vtgField();
+	bool endSentence();
+
+	STATE state;
+	SENTENCE sentence;
+	byte talker;	// NMEA_TALKER_ bit of the current sentence
+	byte sentenceMask;
+	byte talkerMask;
+	byte checksum;
+	byte rxChecksum;
+	byte fieldIndex;
+	byte fieldLen;
+	char field[NMEA_MAX_FIELD + 1];
+
+	uint32_t timeOfDay;	// seconds, RMC sends the time before the date
+	byte gsvInView;	// from the GSV being parsed, goes into inView once the checksum matches
+	byte inView[NMEA_TALKERS];	// per constellation, GPGSV and GLGSV each count only their own
+	GpsFix pending;	// filled as fields arrive, copied to fix once the checksum matches
+	GpsFix fix;
+};
+
+#endif
+
@@ -0,0 +1,64 @@
+// ringbuffer.h
+
+#ifndef _RINGBUFFER_h
+#define _RINGBUFFER_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+// Fixed size FIFO for one producer and one consumer, e.g. an ISR and loop().
+// SIZE must be a power of two, one slot is kept free to tell full from empty.
+template <typename T, uint16_t SIZE>
+class RingBuffer
+{
+public:
+	RingBuffer() : overflows(0), head(0), tail(0) {}
+
+	bool push(const T& v)
+	{
+		uint16_t h = head;
+		uint16_t next = (h + 1) & MASK;
+		if (next == tail)
+		{
+			overflows++;
+			return false;
+		}
+		buf[h] = v;
+		//the slot has to be written before head hands it over
+		__asm__ __volatile__("" ::: "memory");
+		head = next;
+		return true;
+	}
+
+	bool pop(T& v)
+	{
+		uint16_t t = tail;
+		if (t == head)
+			return false;
+		v = buf[t];
+		//and read before tail hands it back
+		__asm__ __volatile__("" ::: "memory");
+		tail = (t + 1) & MASK;
+		return true;
+	}
+
+	uint16_t count() const { return (head - tail) & MASK; }
+	bool isEmpty() const { return head == tail; }
+	void clear() { tail = head; }
+
+	volatile uint16_t overflows;	// pushes dropped because the buffer was full
+
+private:
+	static const uint16_t MASK = SIZE - 1;
+	static_assert((SIZE & MASK) == 0, "RingBuffer SIZE must be a power of two");
+
+	T buf[SIZE];
+	volatile uint16_t head;	// written by the producer only
+	volatile uint16_t tail;	// written by the consumer only
+};
+
+#endif
+
@@ -0,0 +1,233 @@
+// 
+// 
+// 
+
+#include "spectrum.h"
+#include "fastmath.h"
+
+// Q15 twiddles cos/sin(2 pi k / N), k < N/2, and the Hann window
+struct SpectrumCosGen
+{
+	static constexpr int16_t value(int k) { return (int16_t)cxRound(32767 * cxCos(2 * CX_PI * k / SPECTRUM_N)); }
+};
+
+struct SpectrumSinGen
+{
+	static constexpr int16_t value(int k) { return (int16_t)cxRound(32767 * cxSin(2 * CX_PI * k / SPECTRUM_N)); }
+};
+
+struct SpectrumHannGen
+{
+	static constexpr int16_t value(int n) { return (int16_t)cxRound(32767 * 0.5 * (1 - cxCos(2 * CX_PI * n / SPECTRUM_N))); }
+};
+
+typedef ConstTable<int16_t, SpectrumCosGen, MakeIndexList<SPECTRUM_N / 2>::type> SpectrumCos;
+typedef ConstTable<int16_t, SpectrumSinGen, MakeIndexList<SPECTRUM_N / 2>::type> SpectrumSin;
+typedef ConstTable<int16_t, SpectrumHannGen, MakeIndexList<SPECTRUM_N>::type> SpectrumHann;
+
+static const byte bandStart[SPECTRUM_BANDS + 1] = { 1, 4, 8, 16, SPECTRUM_BINS };
+
+static uint32_t isqrt(uint32_t v)
+{
+	uint32_t r = 0;
+	for (uint32_t bit = 1UL << 30; bit; bit >>= 2)
+	{
+		if (v >= r + bit)
+		{
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		}
+		else
+			r >>= 1;
+	}
+	return r;
+}
+
+VibrationSpectrum::VibrationSpectrum()
+{
+	clear();
+	memset(&result, 0, sizeof(result));
+	windows = 0;
+}
+
+void VibrationSpectrum::clear()
+{
+	count = 0;
+}
+
+bool VibrationSpectrum::push(const int16_t* bx, const int16_t* by, const int16_t* bz, const uint32_t* time, uint16_t n)
+{
+	bool done = false;
+
+	for (uint16_t i = 0; i < n; i++)
+	{
+		if (count == 0)
+			firstTime = time[i];
+		x[count] = bx[i];
+		y[count] = by[i];
+		z[count] = bz[i];
+		lastTime = time[i];
+
+		if (++count == SPECTRUM_N)
+		{
+			analyse();
+			count = 0;
+			done = true;
+		}
+	}
+	return done;
+}
+
+// Radix-2 decimation in time, scaled by 1/2 every stage so nothing can overflow and
+// the output is X(k) / N
+void VibrationSpectrum::fft(int16_t* re, int16_t* im)
+{
+	for (uint16_t i = 1, j = 0; i < SPECTRUM_N; i++)
+	{
+		uint16_t bit = SPECTRUM_N >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+
+		if (i < j)
+		{
+			int16_t t = re[i];
+			re[i] = re[j];
+			re[j] = t;
+			t = im[i];
+			im[i] = im[j];
+			im[j] = t;
+		}
+	}
+
+	const int16_t* cosTable = SpectrumCos::values;
+	const int16_t* sinTable = SpectrumSin::values;
+
+	for (uint16_t half = 1, step = SPECTRUM_N / 2; half < SPECTRUM_N; half <<= 1, step >>= 1)
+	{
+		for (uint16_t k = 0; k < half; k++)
+		{
+			int32_t wr = cosTable[k * step];
+			int32_t wi = -sinTable[k * step];
+
+			for (uint16_t a = k; a < SPECTRUM_N; a += 2 * half)
+			{
+				uint16_t b = a + half;
+				int32_t tr = (re[b] * wr - im[b] * wi) >> 15;
+				int32_t ti = (re[b] * wi + im[b] * wr) >> 15;
+				int32_t ar = re[a];
+				int32_t ai = im[a];
+
+				re[a] = (ar + tr) >> 1;
+				im[a] = (ai + ti) >> 1;
+				re[b] = (ar - tr) >> 1;
+				im[b] = (ai - ti) >> 1;
+			}
+		}
+	}
+}
+
+// One sided power of a transformed signal: |C(k)|^2 + |C(N-k)|^2 is the power of both the real
+// and the imaginary input at bin k, so x + jy needs one transform for two axes
+void VibrationSpectrum::addPower(const int16_t* re, const int16_t* im)
+{
+	for (uint16_t k = 1; k < SPECTRUM_BINS; k++)
+	{
+		uint16_t m = SPECTRUM_N - k;
+		power[k] += (uint32_t)(re[k] * re[k] + im[k] * im[k]) + (uint32_t)(re[m] * re[m] + im[m] * im[m]);
+	}
+}
+
+void VibrationSpectrum::analyse()
+{
+	int32_t mean[3] = { 0, 0, 0 };
+	for (uint16_t i = 0; i < SPECTRUM_N; i++)
+	{
+		mean[0] += x[i];
+		mean[1] += y[i];
+		mean[2] += z[i];
+	}
+
+	//take out the mean (gravity and offset), keep the square sum for the rms
+	int16_t* axes[3] = { x, y, z };
+	uint64_t squares = 0;
+	int32_t peak = 0;
+	for (byte a = 0; a < 3; a++)
+	{
+		int16_t* v = axes[a];
+		int16_t m = (mean[a] + SPECTRUM_N / 2) >> SPECTRUM_LOG2N;
+		for (uint16_t i = 0; i < SPECTRUM_N; i++)
+		{
+			int32_t d = v[i] - m;
+			squares += d * d;
+			v[i] = d;
+			if (d < 0)
+				d = -d;
+			if (d > peak)
+				peak = d;
+		}
+	}
+	result.rms = isqrt((uint32_t)(squares >> SPECTRUM_LOG2N));
+
+	//scale all axes alike so the largest is just under 2^13, the FFT then has headroom for x + jy
+	byte shift = 0;
+	while ((shift < 13) && ((peak << (shift + 1)) < (1L << 13)))
+		shift++;
+
+	const int16_t* hann = SpectrumHann::values;
+	for (byte a = 0; a < 3; a++)
+	{
+		int16_t* v = axes[a];
+		for (uint16_t i = 0; i < SPECTRUM_N; i++)
+			v[i] = ((int32_t)(v[i] << shift) * hann[i]) >> 15;
+	}
+
+	memset(power, 0, sizeof(power));
+	fft(x, y);
+	addPower(x, y);
+	memset(x, 0, sizeof(x));
+	fft(z, x);
+	addPower(z, x);
+
+	//bands, the Hann window keeps 3/8 of the power so take it back out along with the shift
+	for (byte b = 0; b < SPECTRUM_BANDS; b++)
+	{
+		uint64_t e = 0;
+		for (uint16_t k = bandStart[b]; k < bandStart[b + 1]; k++)
+			e += power[k];
+		e = ((e * 8 / 3) >> (2 * shift));
+		result.bands[b] = (e > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : (uint32_t)e;
+	}
+
+	//sample rate from the timestamps, N - 1 intervals
+	uint32_t span = lastTime - firstTime;
+	uint32_t rate = span ? (uint32_t)((uint64_t)(SPECTRUM_N - 1) * 10000000UL / span) : 0;	// 0.1 Hz
+	result.sampleRate = rate;
+
+	//dominant bin, refined with a parabola through it and its neighbours
+	uint16_t best = 1;
+	for (uint16_t k = 2; k < SPECTRUM_BINS; k++)
+	{
+		if (power[k] > power[best])
+			best = k;
+	}
+
+	int32_t frac = 0;	// 1/256 bin
+	if ((best > 1) && (best < SPECTRUM_BINS - 1))
+	{
+		int64_t l = power[best - 1];
+		int64_t c = power[best];
+		int64_t r = power[best + 1];
+		int64_t den = 2 * (l - 2 * c + r);
+		if (den != 0)
+			frac = (int32_t)((l - r) * 256 / den);
+		if (frac > 128)
+			frac = 128;
+		if (frac < -128)
+			frac = -128;
+	}
+
+	//bin * rate / N, rate in 0.1 Hz gives 0.01 Hz with the factor 10
+	result.frequency = (uint16_t)((((int64_t)best * 256 + frac) * rate * 10) >> (8 + SPECTRUM_LOG2N));
+	windows++;
+}
@@ -0,0 +1,61 @@
+// spectrum.h
+
+#ifndef _SPECTRUM_h
+#define _SPECTRUM_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#define SPECTRUM_LOG2N 7
+#define SPECTRUM_N (1 << SPECTRUM_LOG2N)	// samples per window, the three axis buffers are 6 * N bytes
+#define SPECTRUM_BINS (SPECTRUM_N / 2)
+#define SPECTRUM_BANDS 4					// bins 1-3, 4-7, 8-15 and 16 up to Nyquist
+
+struct SpectrumResult
+{
+	uint16_t frequency;	// dominant, 0.01 Hz
+	uint16_t sampleRate;	// measured over the window, 0.1 Hz
+	uint16_t rms;		// AC acceleration summed over the three axes, counts
+	uint32_t bands[SPECTRUM_BANDS];	// mean square per band, counts^2, the bands add up to about rms^2
+};
+
+// Vibration spectrum of the accelerometer stream over windows of SPECTRUM_N samples.
+// Each window has its mean taken out, a Hann window applied, and goes through a 16 bit
+// fixed point radix-2 FFT in place in the sample buffers: x and y together as one complex
+// signal, then z. The sample rate comes from the sample timestamps, so it follows whatever
+// bandwidth the chip is set to. RAM is the three buffers plus N/2 powers, 1 KB at N = 128.
+class VibrationSpectrum
+{
+public:
+	VibrationSpectrum();
+
+	void clear();
+
+	// Feed a block from BMA180::drain(), returns true when a window completed and the result changed
+	bool push(const int16_t* x, const int16_t* y, const int16_t* z, const uint32_t* time, uint16_t n);
+
+	const SpectrumResult& getResult() const { return result; }
+
+	uint16_t windows;	// analysed so far
+
+private:
+	void analyse();
+	static void fft(int16_t* re, int16_t* im);
+	void addPower(const int16_t* re, const int16_t* im);
+
+	int16_t x[SPECTRUM_N];
+	int16_t y[SPECTRUM_N];
+	int16_t z[SPECTRUM_N];
+	uint32_t power[SPECTRUM_BINS];
+	uint16_t count;
+	uint32_t firstTime;	// micros() of the window's first and last samples
+	uint32_t lastTime;
+
+	SpectrumResult result;
+};
+
+#endif
+
@@ -0,0 +1,30 @@
+// bench.h
+
+#ifndef _BENCH_h
+#define _BENCH_h
+
+#include <chrono>
+
+// Keeps the compiler from dropping work whose result is never used
+static inline void benchKeep(const void* p)
+{
+	__asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+// ns per item for f(), which processes items things, best of runs so a busy machine doesn't skew it
+template <typename F>
+double benchNs(F f, double items, int runs = 5)
+{
+	double best = 0;
+	for (int r = 0; r < runs; r++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		f();
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		if ((r == 0) || (ns < best))
+			best = ns;
+	}
+	return best / items;
+}
+
+#endif
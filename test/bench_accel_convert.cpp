@@ -0,0 +1,136 @@
+// BMA180 block conversions to milli-g and g against the per axis getXValFloat() calls they
+// replaced, accuracy over every count in every range and time per sample of three axes.
+
+#include "bma180.h"
+#include "bench.h"
+#include <random>
+#include <vector>
+
+// The getters as they were: a switch for the range and a double divide on every call
+class OldAccel
+{
+public:
+	int x, y, z;
+	BMA180::GSENSITIVITY gSense;
+
+	__attribute__((noinline)) float getGSense()
+	{
+		switch (gSense)
+		{
+		case BMA180::G1: return 1.0;
+		case BMA180::G15: return 1.5;
+		case BMA180::G2: return 2.0;
+		case BMA180::G3: return 3.0;
+		case BMA180::G4: return 4.0;
+		case BMA180::G8: return 8.0;
+		case BMA180::G16: return 16.0;
+		}
+		return 0;
+	}
+
+	__attribute__((noinline)) float getXValFloat() { return (float)x / 8191.0*getGSense(); }
+	__attribute__((noinline)) float getYValFloat() { return (float)y / 8191.0*getGSense(); }
+	__attribute__((noinline)) float getZValFloat() { return (float)z / 8191.0*getGSense(); }
+};
+
+static const double rangeG[] = { 1, 1.5, 2, 3, 4, 8, 16 };
+
+int main()
+{
+	BMA180 bma;
+	double worstMilliG = 0, worstQ16 = 0, worstG = 0;
+	for (int r = BMA180::G1; r <= BMA180::G16; r++)
+	{
+		bma.restoreGSensitivity((BMA180::GSENSITIVITY)r);
+		for (int c = -8192; c < 8192; c++)
+		{
+			int16_t count = c, mg;
+			int32_t q16;
+			float g;
+			bma.toMilliG(&count, &mg, 1);
+			bma.toMilliGQ16(&count, &q16, 1);
+			bma.toG(&count, &g, 1);
+
+			double exact = c / 8191.0 * rangeG[r];
+			worstMilliG = fmax(worstMilliG, fabs(mg - exact * 1000));
+			worstQ16 = fmax(worstQ16, fabs(q16 / 65536.0 - exact * 1000));
+			if (c != 0)
+				worstG = fmax(worstG, fabs(g - exact) / fabs(exact));
+		}
+	}
+	printf("every count in every range: toMilliG worst %.3f mg, toMilliGQ16 worst %.4f mg, toG worst %.1e relative\n",
+		worstMilliG, worstQ16, worstG);
+
+	const int N = 1024;
+	const int RUNS = 2000;
+	std::vector<int16_t> x(N), y(N), z(N), mx(N), my(N), mz(N);
+	std::vector<int32_t> qx(N), qy(N), qz(N);
+	std::vector<float> fx(N), fy(N), fz(N);
+	std::mt19937 random(1);
+	for (int i = 0; i < N; i++)
+	{
+		x[i] = (int16_t)(random() % 16384) - 8192;
+		y[i] = (int16_t)(random() % 16384) - 8192;
+		z[i] = (int16_t)(random() % 16384) - 8192;
+	}
+
+	OldAccel old;
+	old.gSense = BMA180::G2;
+	bma.restoreGSensitivity(BMA180::G2);
+	const double samples = (double)N * RUNS;
+
+	double oldNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			for (int i = 0; i < N; i++)
+			{
+				old.x = x[i];
+				old.y = y[i];
+				old.z = z[i];
+				fx[i] = old.getXValFloat();
+				fy[i] = old.getYValFloat();
+				fz[i] = old.getZValFloat();
+			}
+			benchKeep(fx.data());
+		}
+	}, samples);
+	double gNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			bma.toG(x.data(), fx.data(), N);
+			bma.toG(y.data(), fy.data(), N);
+			bma.toG(z.data(), fz.data(), N);
+			benchKeep(fx.data());
+		}
+	}, samples);
+	double mgNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			bma.toMilliG(x.data(), mx.data(), N);
+			bma.toMilliG(y.data(), my.data(), N);
+			bma.toMilliG(z.data(), mz.data(), N);
+			benchKeep(mx.data());
+		}
+	}, samples);
+	double q16Ns = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			bma.toMilliGQ16(x.data(), qx.data(), N);
+			bma.toMilliGQ16(y.data(), qy.data(), N);
+			bma.toMilliGQ16(z.data(), qz.data(), N);
+			benchKeep(qx.data());
+		}
+	}, samples);
+
+	printf("getXValFloat x3  %6.2f ns/sample\n", oldNs);
+	printf("toG              %6.2f ns/sample, %.1fx\n", gNs, oldNs / gNs);
+	printf("toMilliG         %6.2f ns/sample, %.1fx\n", mgNs, oldNs / mgNs);
+	printf("toMilliGQ16      %6.2f ns/sample, %.1fx\n", q16Ns, oldNs / q16Ns);
+	printf("(the ESP8266 has no FPU, the integer paths gain far more there)\n");
+	//the Q16 scale is rounded, half an lsb of it over 8192 counts is 1/16 mg
+	return ((worstMilliG > 0.5 + 1 / 16.0) || (worstQ16 > 1 / 16.0)) ? 1 : 0;
+}
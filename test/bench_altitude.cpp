@@ -0,0 +1,94 @@
+// The table driven pressureToAltitude() and altitudeToSealevel() against the pow() formulas
+// they replaced, worst error by pressure and altitude band against the limits bmp085.cpp
+// documents, and time per call.
+
+#include "bmp085.h"
+#include "bench.h"
+
+// The Adafruit library's formulas, float in and out as readAltitude() and readSealevelPressure() had them
+__attribute__((noinline)) static float oldAltitude(int32_t pressure, float sealevelPressure)
+{
+	return 44330 * (1.0 - pow(pressure / sealevelPressure, 0.1903));
+}
+
+__attribute__((noinline)) static int32_t oldSealevel(int32_t pressure, float altitude_meters)
+{
+	return (int32_t)(pressure / pow(1.0 - altitude_meters / 44330, 5.255));
+}
+
+int main()
+{
+	int bad = 0;
+
+	//altitude in cm from 30 kPa up, over the sea level pressures weather actually brings
+	for (int32_t low = 30000; low < 110000; low += 20000)
+	{
+		double worst = 0;
+		for (int32_t p0 = 95000; p0 <= 105000; p0 += 2500)
+		{
+			for (int32_t p = low; p < low + 20000; p += 3)
+			{
+				double exact = 4433000.0 * (1 - pow((double)p / p0, 0.1903));
+				double e = fabs(Adafruit_BMP085::pressureToAltitude(p, p0) - exact);
+				if (e > worst)
+					worst = e;
+			}
+		}
+		//11 cm above 70 kPa, 50 cm below
+		double limit = (low >= 70000) ? 11 : 50;
+		printf("pressureToAltitude  %6d..%6d Pa  worst %5.2f cm  (limit %.0f)\n", low, low + 20000, worst, limit);
+		if (worst > limit)
+			bad++;
+	}
+
+	//sea level pressure from a pressure and altitude on the standard atmosphere
+	for (int32_t low = -60000; low < 980000; low += 260000)
+	{
+		double worst = 0;
+		for (int32_t h = low; h < low + 260000; h += 37)
+		{
+			int32_t p = (int32_t)(101325 * pow(1 - h / 4433000.0, 5.255));
+			double exact = p / pow(1 - h / 4433000.0, 5.255);
+			double e = fabs(Adafruit_BMP085::altitudeToSealevel(p, h) - exact);
+			if (e > worst)
+				worst = e;
+		}
+		printf("altitudeToSealevel  %6d..%6d cm  worst %5.2f Pa  (limit 3)\n", low, low + 260000, worst);
+		if (worst > 3)
+			bad++;
+	}
+
+	const int N = 1000000;
+	int64_t sum = 0;
+	float fsum = 0;
+
+	double tableAlt = benchNs([&]()
+	{
+		for (int i = 0; i < N; i++)
+			sum += Adafruit_BMP085::pressureToAltitude(70000 + (i & 0x7FFF), 101325);
+		benchKeep(&sum);
+	}, N);
+	double powAlt = benchNs([&]()
+	{
+		for (int i = 0; i < N; i++)
+			fsum += oldAltitude(70000 + (i & 0x7FFF), 101325);
+		benchKeep(&fsum);
+	}, N);
+	double tableSl = benchNs([&]()
+	{
+		for (int i = 0; i < N; i++)
+			sum += Adafruit_BMP085::altitudeToSealevel(95000, i & 0xFFFF);
+		benchKeep(&sum);
+	}, N);
+	double powSl = benchNs([&]()
+	{
+		for (int i = 0; i < N; i++)
+			sum += oldSealevel(95000, (i & 0xFFFF) / 100.0f);
+		benchKeep(&sum);
+	}, N);
+
+	printf("pressureToAltitude  %6.2f ns/call, pow() %6.2f ns/call, %.1fx\n", tableAlt, powAlt, powAlt / tableAlt);
+	printf("altitudeToSealevel  %6.2f ns/call, pow() %6.2f ns/call, %.1fx\n", tableSl, powSl, powSl / tableSl);
+	printf("(a host FPU flatters pow(), the ESP8266 does it in soft float)\n");
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,94 @@
+// BMA180::unpack() against the per sample decode readAccel() used to do, after checking it
+// against that decode for every 14 bit value and temperature byte.
+
+#include "bma180.h"
+#include "bench.h"
+#include <random>
+#include <vector>
+
+// readAccel()'s decode, lsb >> 2 plus msb << 6 and a branch to set the sign bits, into the
+// same arrays so only the kernel differs
+__attribute__((noinline)) static void oldUnpack(const AccelRaw* raw, int16_t* x, int16_t* y, int16_t* z, int16_t* temp, uint16_t n)
+{
+	for (uint16_t i = 0; i < n; i++)
+	{
+		const byte* d = raw[i].data;
+		int lsb = d[0] >> 2;
+		int msb = d[1];
+		int v = (msb << 6) + lsb;
+		if (v & 0x2000) v |= 0xc000; // set full 2 complement for neg values
+		x[i] = v;
+		lsb = d[2] >> 2;
+		msb = d[3];
+		v = (msb << 6) + lsb;
+		if (v & 0x2000) v |= 0xc000;
+		y[i] = v;
+		lsb = d[4] >> 2;
+		msb = d[5];
+		v = (msb << 6) + lsb;
+		if (v & 0x2000) v |= 0xc000;
+		z[i] = v;
+		v = d[6];
+		if (v & 0x80) v |= 0xff00;
+		temp[i] = v;
+	}
+}
+
+int main()
+{
+	//every 14 bit count on each axis, with the new_data and spare lsb bits set, and every temperature
+	int bad = 0;
+	for (int v = 0; v < 16384; v++)
+	{
+		AccelRaw r;
+		r.data[0] = ((v & 0x3F) << 2) | 0x01;
+		r.data[1] = v >> 6;
+		r.data[2] = ((v & 0x3F) << 2) | 0x02;
+		r.data[3] = r.data[1];
+		r.data[4] = ((v & 0x3F) << 2) | 0x03;
+		r.data[5] = r.data[1];
+		r.data[6] = v & 0xFF;
+		r.time = v;
+
+		int16_t x, y, z, t, ox, oy, oz, ot;
+		uint32_t time;
+		BMA180::unpack(&r, &x, &y, &z, &t, &time, 1);
+		oldUnpack(&r, &ox, &oy, &oz, &ot, 1);
+		if ((x != ox) || (y != ox) || (z != ox) || (t != ot) || (time != (uint32_t)v))
+			bad++;
+	}
+	printf("unpack matches the old decode on all 16384 values: %s\n", bad ? "NO" : "yes");
+
+	const int N = 4096;
+	const int RUNS = 500;
+	std::vector<AccelRaw> raw(N);
+	std::mt19937 random(1);
+	for (int i = 0; i < N; i++)
+	{
+		for (int j = 0; j < 7; j++)
+			raw[i].data[j] = random();
+		raw[i].time = i;
+	}
+	std::vector<int16_t> x(N), y(N), z(N), t(N);
+
+	double newNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			BMA180::unpack(raw.data(), x.data(), y.data(), z.data(), t.data(), NULL, N);
+			benchKeep(x.data());
+		}
+	}, (double)N * RUNS);
+	double oldNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			oldUnpack(raw.data(), x.data(), y.data(), z.data(), t.data(), N);
+			benchKeep(x.data());
+		}
+	}, (double)N * RUNS);
+
+	printf("BMA180::unpack  %5.2f ns/sample\n", newNs);
+	printf("old decode      %5.2f ns/sample, %.1fx\n", oldNs, oldNs / newNs);
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+// RunningMedian and HampelFilter update cost at windows of 5 to 101 samples, against sorting a
+// copy of the window for every sample, after checking the running median against that sort.
+
+#include "median.h"
+#include "bench.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// The sort per window the streaming median replaces, insertion sort as small code would have it
+template <uint16_t SIZE>
+class SortedMedian
+{
+public:
+	SortedMedian() : idx(0), n(0) {}
+
+	__attribute__((noinline)) int32_t update(int32_t v)
+	{
+		data[idx] = v;
+		if (++idx == SIZE)
+			idx = 0;
+		if (n < SIZE)
+			n++;
+
+		int32_t sorted[SIZE];
+		for (uint16_t i = 0; i < n; i++)
+		{
+			int32_t x = data[i];
+			uint16_t j = i;
+			for (; (j > 0) && (sorted[j - 1] > x); j--)
+				sorted[j] = sorted[j - 1];
+			sorted[j] = x;
+		}
+		return (n & 1) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+	}
+
+private:
+	int32_t data[SIZE];
+	uint16_t idx;
+	uint16_t n;
+};
+
+// Median after every push against std::sort of the same window, with a mix of small values,
+// large ones and negatives so the heaps see both halves churn
+template <uint16_t SIZE>
+static int mismatches()
+{
+	RunningMedian<SIZE> median;
+	std::vector<int32_t> window;
+	std::mt19937 random(SIZE);
+	int bad = 0;
+	for (int k = 0; k < 20000; k++)
+	{
+		int32_t v = (int32_t)(random() % ((k % 3) ? 50 : 100000)) - ((k % 7) ? 0 : 50000);
+		median.push(v);
+		window.push_back(v);
+		if (window.size() > SIZE)
+			window.erase(window.begin());
+
+		std::vector<int32_t> sorted(window);
+		std::sort(sorted.begin(), sorted.end());
+		size_t n = sorted.size();
+		int32_t expected = (n & 1) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+		if ((median.median() != expected) || (median.count() != n))
+			bad++;
+	}
+	return bad;
+}
+
+// Returns how many medians were wrong
+template <uint16_t SIZE>
+static int bench(const std::vector<int32_t>& in)
+{
+	int bad = mismatches<SIZE>();
+
+	RunningMedian<SIZE> median;
+	int64_t sum = 0;
+	double runningNs = benchNs([&]()
+	{
+		for (size_t i = 0; i < in.size(); i++)
+		{
+			median.push(in[i]);
+			sum += median.median();
+		}
+		benchKeep(&sum);
+	}, in.size());
+
+	HampelFilter<SIZE> hampel(3, 50);
+	double hampelNs = benchNs([&]()
+	{
+		for (size_t i = 0; i < in.size(); i++)
+			sum += hampel.update(in[i]);
+		benchKeep(&sum);
+	}, in.size());
+
+	SortedMedian<SIZE> sorted;
+	double sortNs = benchNs([&]()
+	{
+		for (size_t i = 0; i < in.size(); i++)
+			sum += sorted.update(in[i]);
+		benchKeep(&sum);
+	}, in.size(), 1);
+
+	printf("window %3u  RunningMedian %6.1f ns  HampelFilter %6.1f ns  sort %7.1f ns  %5.1fx  (%d wrong)\n",
+		SIZE, runningNs, hampelNs, sortNs, sortNs / runningNs, bad);
+	return bad;
+}
+
+int main()
+{
+	//pressure counts with noise and the odd bad read far off
+	std::mt19937 random(1);
+	std::normal_distribution<double> noise(0, 6);
+	std::vector<int32_t> in(1 << 18);
+	for (size_t i = 0; i < in.size(); i++)
+		in[i] = 100000 + lround(noise(random)) - ((i % 997 == 500) ? 20000 : 0);
+
+	int bad = bench<5>(in);
+	bad += bench<9>(in);
+	bad += bench<21>(in);
+	bad += bench<51>(in);
+	bad += bench<101>(in);
+
+	//every injected spike should be replaced at the window the barometer uses
+	HampelFilter<9> hampel(3, 50);
+	int spikes = 0, missed = 0;
+	for (size_t i = 0; i < in.size(); i++)
+	{
+		bool spike = (i % 997 == 500);
+		spikes += spike;
+		if ((hampel.update(in[i]) == in[i]) && spike)
+			missed++;
+	}
+	printf("HampelFilter<9>  %d spikes, %u replaced, %d missed\n", spikes, hampel.outliers, missed);
+	return (bad || missed) ? 1 : 0;
+}
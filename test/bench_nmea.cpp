@@ -0,0 +1,152 @@
+// NmeaParser against the String based parser it replaced, on one second of a receiver's
+// default NMEA output, bytes per second of CPU and heap calls per second of GPS data.
+
+#include "nmea.h"
+#include "bench.h"
+#include <string>
+
+// The baseline sketch's parser, without the Serial echo of every byte and line
+static String nmeaLine;
+static bool gotGprmc;
+static String gpsTime;
+static String gpsDate;
+static String gpsLat;
+static String gpsLong;
+
+static String getNextNmeaToken(String& line, int& start)
+{
+	String result;
+	int i = start;
+
+	while (i < (int)line.length())
+	{
+		char c = line[i];
+
+		if (c == ',')
+		{
+			if (start < i)
+				result = line.substring(start, i);
+			else
+				result = "";
+			start = i + 1;
+			break;
+		}
+		++i;
+	}
+
+	return result;
+}
+
+static void parseNmeaLine()
+{
+	if (nmeaLine.startsWith("$GPRMC,"))
+	{
+		int i = 7;
+		gpsTime = getNextNmeaToken(nmeaLine, i);
+		String okStr = getNextNmeaToken(nmeaLine, i);
+
+		if (okStr == "A")
+		{
+			gpsLat = getNextNmeaToken(nmeaLine, i);
+			String lnsStr = getNextNmeaToken(nmeaLine, i);
+			gpsLat += lnsStr;
+
+			gpsLong = getNextNmeaToken(nmeaLine, i);
+			String lewStr = getNextNmeaToken(nmeaLine, i);
+			gpsLong += lewStr;
+
+			String spdStr = getNextNmeaToken(nmeaLine, i);
+			String crsStr = getNextNmeaToken(nmeaLine, i);
+			gpsDate = getNextNmeaToken(nmeaLine, i);
+			String magStr = getNextNmeaToken(nmeaLine, i);
+		}
+		else
+		{
+			gpsLat = "";
+			gpsLong = "";
+			gpsTime = "";
+			gpsDate = "";
+		}
+
+		gotGprmc = true;
+	}
+}
+
+static void oldEncode(char c)
+{
+	if (c > 13)
+	{
+		nmeaLine += c;
+	}
+	else
+	{
+		parseNmeaLine();
+		nmeaLine = "";
+	}
+}
+
+// What a NEO-6 sends every second out of the box
+static const char* const sentences[] =
+{
+	"GPRMC,123519.00,A,4807.03812,N,01131.00045,E,0.224,84.40,230394,,,A",
+	"GPVTG,84.40,T,,M,0.224,N,0.415,K,A",
+	"GPGGA,123519.00,4807.03812,N,01131.00045,E,1,08,0.94,545.4,M,46.9,M,,",
+	"GPGSA,A,3,04,05,09,12,17,24,25,29,,,,,1.75,0.94,1.48",
+	"GPGSV,3,1,11,02,17,306,18,04,62,092,41,05,26,202,33,09,20,045,30",
+	"GPGSV,3,2,11,12,76,247,44,17,36,136,40,24,11,296,26,25,44,272,38",
+	"GPGSV,3,3,11,29,14,180,29,31,06,330,,33,29,213,",
+	"GPGLL,4807.03812,N,01131.00045,E,123519.00,A,A",
+};
+
+int main()
+{
+	std::string second;
+	for (size_t i = 0; i < sizeof(sentences) / sizeof(sentences[0]); i++)
+	{
+		byte checksum = 0;
+		for (const char* c = sentences[i]; *c; c++)
+			checksum ^= *c;
+		char tail[8];
+		snprintf(tail, sizeof(tail), "*%02X\r\n", checksum);
+		second += "$";
+		second += sentences[i];
+		second += tail;
+	}
+
+	const int SECONDS = 20000;
+	const double bytes = (double)second.size() * SECONDS;
+
+	NmeaParser parser;
+	unsigned long fixes = 0;
+	double newNs = benchNs([&]()
+	{
+		for (int s = 0; s < SECONDS; s++)
+		{
+			for (size_t i = 0; i < second.size(); i++)
+				fixes += parser.encode(second[i]);
+		}
+	}, bytes);
+
+	unsigned long before = String::allocations;
+	unsigned long oldFixes = 0;
+	double oldNs = benchNs([&]()
+	{
+		for (int s = 0; s < SECONDS; s++)
+		{
+			for (size_t i = 0; i < second.size(); i++)
+				oldEncode(second[i]);
+			oldFixes += gotGprmc;
+			gotGprmc = false;
+		}
+	}, bytes);
+	double oldAllocs = (double)(String::allocations - before) / (5.0 * SECONDS);
+
+	const GpsFix& fix = parser.getFix();
+	printf("%u bytes of NMEA per second, fix %ld,%ld valid %d, %u checksum errors\n",
+		(unsigned)second.size(), (long)fix.lat, (long)fix.lon, fix.valid, parser.errors);
+	printf("NmeaParser          %6.2f ns/byte, 0 heap calls per second (%lu fixes)\n", newNs, fixes);
+	printf("getNextNmeaToken    %6.2f ns/byte, %.0f heap calls per second (%lu fixes, lat %s)\n",
+		oldNs, oldAllocs, oldFixes, gpsLat.c_str());
+	printf("speedup             %6.1fx\n", oldNs / newNs);
+	return 0;
+}
@@ -0,0 +1,95 @@
+// VibrationSpectrum on synthetic mast motion: the dominant frequency, rms and band powers
+// reported for pure tones across the band, and what one window's analysis costs.
+
+#include "spectrum.h"
+#include "bench.h"
+#include <random>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#define SAMPLE_RATE 75.0	// Hz, the BMA180 at its 75 Hz filter with smp_skip
+
+// Feeds a tone on x and y and a smaller one on z over gravity until a window completes
+static const SpectrumResult& tone(VibrationSpectrum& spectrum, double f, std::mt19937& random)
+{
+	std::uniform_int_distribution<int> noise(-3, 3);
+	int16_t x[16], y[16], z[16];
+	uint32_t time[16];
+	long n = 0;
+	spectrum.clear();
+	for (;;)
+	{
+		for (int i = 0; i < 16; i++, n++)
+		{
+			double t = n / SAMPLE_RATE;
+			x[i] = (int16_t)lround(200 * sin(2 * M_PI * f * t) + noise(random));
+			y[i] = (int16_t)lround(120 * cos(2 * M_PI * f * t) + noise(random));
+			z[i] = (int16_t)lround(8191 + 30 * sin(2 * M_PI * f * t + 1));
+			time[i] = (uint32_t)lround(t * 1e6) + 1000;
+		}
+		if (spectrum.push(x, y, z, time, 16))
+			return spectrum.getResult();
+	}
+}
+
+int main()
+{
+	VibrationSpectrum spectrum;
+	std::mt19937 random(1);
+	const double bin = SAMPLE_RATE / SPECTRUM_N;
+	const double rms = sqrt((200 * 200 + 120 * 120 + 30 * 30) / 2.0 + 2 * 4);
+	int bad = 0;
+
+	printf("bin width %.3f Hz, expected rms %.0f counts\n", bin, rms);
+	const double tones[] = { 0.7, 2.3, 5.0, 11.1, 20.0, 30.0 };
+	for (size_t i = 0; i < sizeof(tones) / sizeof(tones[0]); i++)
+	{
+		const SpectrumResult& r = tone(spectrum, tones[i], random);
+		double f = r.frequency / 100.0;
+		uint64_t sum = 0;
+		for (int b = 0; b < SPECTRUM_BANDS; b++)
+			sum += r.bands[b];
+		printf("tone %5.2f Hz -> %5.2f Hz  rate %4.1f Hz  rms %3u  bands %6u %6u %6u %6u  (sqrt sum %.0f)\n",
+			tones[i], f, r.sampleRate / 10.0, r.rms, r.bands[0], r.bands[1], r.bands[2], r.bands[3], sqrt((double)sum));
+
+		//within half a bin, and the rms within 10%
+		if ((fabs(f - tones[i]) > bin / 2) || (fabs(r.rms - rms) > 0.1 * rms) || (fabs(r.sampleRate / 10.0 - SAMPLE_RATE) > 0.2))
+			bad++;
+	}
+
+	//one window's analysis, the last sample of a window is what triggers it
+	int16_t x[SPECTRUM_N], y[SPECTRUM_N], z[SPECTRUM_N];
+	uint32_t time[SPECTRUM_N];
+	for (int i = 0; i < SPECTRUM_N; i++)
+	{
+		x[i] = random() % 2000;
+		y[i] = random() % 2000;
+		z[i] = 8000 + random() % 200;
+		time[i] = i * 13333;
+	}
+	const int RUNS = 2000;
+	double ns = 0;
+	unsigned long long cycles = ~0ULL;
+	for (int k = 0; k < RUNS; k++)
+	{
+		spectrum.push(x, y, z, time, SPECTRUM_N - 1);
+		ns += benchNs([&]()
+		{
+			spectrum.push(x + SPECTRUM_N - 1, y + SPECTRUM_N - 1, z + SPECTRUM_N - 1, time + SPECTRUM_N - 1, 1);
+		}, 1, 1);
+#if defined(__i386__) || defined(__x86_64__)
+		spectrum.push(x, y, z, time, SPECTRUM_N - 1);
+		unsigned long long start = __rdtsc();
+		spectrum.push(x + SPECTRUM_N - 1, y + SPECTRUM_N - 1, z + SPECTRUM_N - 1, time + SPECTRUM_N - 1, 1);
+		unsigned long long end = __rdtsc();
+		if (end - start < cycles)
+			cycles = end - start;
+#endif
+	}
+	printf("window of %d analysed in %.0f ns mean", SPECTRUM_N, ns / RUNS);
+	if (cycles != ~0ULL)
+		printf(", %llu TSC cycles best", cycles);
+	printf(", %u bytes of state\n", (unsigned)sizeof(VibrationSpectrum));
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+// trig.h against libm: a sweep for the maximum errors the header documents, then time per call
+// against what the call sites used before (atan2f in degrees, asin, sin and cos).
+
+#include "trig.h"
+#include "bench.h"
+#include <random>
+#include <vector>
+
+#define MILLIDEG_PER_RAD (180000 / M_PI)
+
+// Difference of two angles in millidegrees, the short way round
+static double angleError(double a, double b)
+{
+	double d = fabs(a - b);
+	return (d > 180000) ? 360000 - d : d;
+}
+
+// The tilt angle as loop() had it
+__attribute__((noinline)) static float oldTilt(float y, float x)
+{
+	return atan2f(y, x) * 180 / 3.141592f;
+}
+
+int main()
+{
+	std::mt19937 random(1);
+
+	//16 bit accelerometer range densely, then anything an int32 can hold
+	double atanMilli = 0, atanMilliWide = 0, atanF = 0;
+	for (int y = -8192; y <= 8192; y += 3)
+	{
+		for (int x = -8192; x <= 8192; x += 7)
+		{
+			if (!x && !y)
+				continue;
+			double exact = atan2((double)y, (double)x);
+			atanMilli = fmax(atanMilli, angleError(atan2Milli(y, x), exact * MILLIDEG_PER_RAD));
+			atanF = fmax(atanF, angleError(fastAtan2f(y, x) * MILLIDEG_PER_RAD, exact * MILLIDEG_PER_RAD));
+		}
+	}
+	for (int k = 0; k < 1000000; k++)
+	{
+		int32_t y = (int32_t)random(), x = (int32_t)random();
+		atanMilliWide = fmax(atanMilliWide, angleError(atan2Milli(y, x), atan2((double)y, (double)x) * MILLIDEG_PER_RAD));
+	}
+
+	double asinErr = 0;
+	for (double x = -1; x <= 1; x += 1e-5)
+		asinErr = fmax(asinErr, fabs(fastAsinf(x) - asin(x)) * MILLIDEG_PER_RAD);
+
+	double sinCosErr = 0;
+	for (double a = -8 * M_PI; a <= 8 * M_PI; a += 1e-4)
+	{
+		//against the float the function actually gets, up here its rounding alone is 1e-6
+		float af = a;
+		float s, c;
+		fastSinCosf(af, &s, &c);
+		sinCosErr = fmax(sinCosErr, fmax(fabs(s - sin((double)af)), fabs(c - cos((double)af))));
+	}
+
+	printf("atan2Milli   %.2f mdeg at 16 bits, %.2f mdeg over int32\n", atanMilli, atanMilliWide);
+	printf("fastAtan2f   %.2f mdeg\n", atanF);
+	printf("fastAsinf    %.2f mdeg\n", asinErr);
+	printf("fastSinCosf  %.2e\n", sinCosErr);
+
+	const int N = 4096;
+	const int RUNS = 500;
+	std::vector<float> fy(N), fx(N), out(N), out2(N);
+	std::vector<int32_t> iy(N), ix(N), iout(N);
+	for (int i = 0; i < N; i++)
+	{
+		iy[i] = (int32_t)(random() % 16384) - 8192;
+		ix[i] = (int32_t)(random() % 16384) - 8192;
+		fy[i] = iy[i];
+		fx[i] = ix[i];
+	}
+	const double calls = (double)N * RUNS;
+
+	double tiltNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			for (int i = 0; i < N; i++)
+				out[i] = oldTilt(fy[i], fx[i]);
+			benchKeep(out.data());
+		}
+	}, calls);
+	double milliNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			for (int i = 0; i < N; i++)
+				iout[i] = atan2Milli(iy[i], ix[i]);
+			benchKeep(iout.data());
+		}
+	}, calls);
+	double atan2Ns = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			for (int i = 0; i < N; i++)
+				out[i] = atan2(fy[i], fx[i]);
+			benchKeep(out.data());
+		}
+	}, calls);
+	double fastAtanNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			for (int i = 0; i < N; i++)
+				out[i] = fastAtan2f(fy[i], fx[i]);
+			benchKeep(out.data());
+		}
+	}, calls);
+	double asinNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			for (int i = 0; i < N; i++)
+				out[i] = asin(fy[i] / 8192.0f);
+			benchKeep(out.data());
+		}
+	}, calls);
+	double fastAsinNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			for (int i = 0; i < N; i++)
+				out[i] = fastAsinf(fy[i] / 8192.0f);
+			benchKeep(out.data());
+		}
+	}, calls);
+	double sinCosNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			for (int i = 0; i < N; i++)
+			{
+				out[i] = sin(fy[i] * 1e-3f);
+				out2[i] = cos(fy[i] * 1e-3f);
+			}
+			benchKeep(out.data());
+			benchKeep(out2.data());
+		}
+	}, calls);
+	double fastSinCosNs = benchNs([&]()
+	{
+		for (int r = 0; r < RUNS; r++)
+		{
+			for (int i = 0; i < N; i++)
+				fastSinCosf(fy[i] * 1e-3f, &out[i], &out2[i]);
+			benchKeep(out.data());
+			benchKeep(out2.data());
+		}
+	}, calls);
+
+	printf("atan2f degrees %6.2f ns  atan2Milli  %6.2f ns  %.1fx\n", tiltNs, milliNs, tiltNs / milliNs);
+	printf("atan2          %6.2f ns  fastAtan2f  %6.2f ns  %.1fx\n", atan2Ns, fastAtanNs, atan2Ns / fastAtanNs);
+	printf("asin           %6.2f ns  fastAsinf   %6.2f ns  %.1fx\n", asinNs, fastAsinNs, asinNs / fastAsinNs);
+	printf("sin + cos      %6.2f ns  fastSinCosf %6.2f ns  %.1fx\n", sinCosNs, fastSinCosNs, sinCosNs / fastSinCosNs);
+	printf("(libm has the host FPU, on the ESP8266 all of it is soft float)\n");
+
+	//the limits trig.h documents
+	return ((atanMilli > 2) || (atanMilliWide > 3.1) || (atanF > 0.7) || (asinErr > 0.7) || (sinCosErr > 1e-6)) ? 1 : 0;
+}
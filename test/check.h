@@ -0,0 +1,28 @@
+// check.h
+
+#ifndef _CHECK_h
+#define _CHECK_h
+
+#include <stdio.h>
+
+// Minimal assertions for the host tests, a failure is reported and counted but the test carries on
+static int checkFailures;
+
+#define CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			checkFailures++; \
+		} \
+	} while (0)
+
+// What main() returns
+static int checkResult()
+{
+	printf("%s\n", checkFailures ? "FAILED" : "ok");
+	return checkFailures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,349 @@
+// simreceiver.h
+
+#ifndef _SIMRECEIVER_h
+#define _SIMRECEIVER_h
+
+#include "Arduino.h"
+#include "EspSoftSerialRx.h"
+#include <deque>
+#include <vector>
+
+// A u-blox receiver on the far end of Serial1 and the soft serial RX line. It only hears the
+// host when both run at the same rate, answers CFG commands with ACK-ACK (or ACK-NAK while
+// nakRemaining lasts) and keeps what it was told so a test can check it. RXM-PMREQ puts it
+// in backup, and it wakes with the configuration last saved by CFG-CFG, like the real one.
+class SimReceiver : public SimSerialPeer
+{
+public:
+	SimReceiver(unsigned long rate = 9600)
+	{
+		baud = rate;
+		hostBaud = 0;
+		outProto = 0x0003;
+		measRate = 1000;
+		memset(msgRate, 0, sizeof(msgRate));
+		mute = false;
+		fixedBaud = false;
+		nakRemaining = 0;
+		commands = 0;
+		polls = 0;
+		gnssRunning = true;
+		sosDelay = 500;
+		sosBackups = 0;
+		sleeps = 0;
+		asleep = false;
+		wakeAt = 0;
+		wakes = 0;
+		configSaves = 0;
+		injectedPosition = false;
+		injectedTime = false;
+		injectedYear = 0;
+		saveConfig();
+		Serial1.peer = this;
+		simSoftSerialPeer = this;
+	}
+
+	~SimReceiver()
+	{
+		Serial1.peer = NULL;
+		simSoftSerialPeer = NULL;
+	}
+
+	void hostBegin(unsigned long rate) { hostBaud = rate; }
+
+	void hostWrite(const uint8_t* data, size_t len)
+	{
+		//any edge on RX wakes it from backup, what woke it is lost
+		if (isAsleep())
+		{
+			wake();
+			return;
+		}
+		//at the wrong rate the receiver just sees framing errors
+		if (hostBaud != baud)
+			return;
+		rx.insert(rx.end(), data, data + len);
+		parse();
+	}
+
+	bool hostRead(uint8_t& c, unsigned long rate)
+	{
+		while (!tx.empty() && ((int32_t)(millis() - tx.front().due) >= 0))
+		{
+			Byte b = tx.front();
+			tx.pop_front();
+			if (b.baud == rate)
+			{
+				c = b.value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Queues a UBX frame for the host, delay ms from now
+	void sendFrame(uint8_t cls, uint8_t id, const uint8_t* payload, uint16_t len, uint32_t delay = 0)
+	{
+		std::vector<uint8_t> f;
+		f.push_back(0xB5);
+		f.push_back(0x62);
+		f.push_back(cls);
+		f.push_back(id);
+		f.push_back(len & 0xFF);
+		f.push_back(len >> 8);
+		f.insert(f.end(), payload, payload + len);
+		uint8_t a = 0, b = 0;
+		for (size_t i = 2; i < f.size(); i++)
+		{
+			a += f[i];
+			b += a;
+		}
+		f.push_back(a);
+		f.push_back(b);
+		for (size_t i = 0; i < f.size(); i++)
+		{
+			Byte out = { f[i], baud, (uint32_t)millis() + delay };
+			tx.push_back(out);
+		}
+	}
+
+	// One navigation solution, NAV-PVT only goes out if the receiver is awake and has it enabled
+	void navigate(bool valid, int32_t lat, int32_t lon)
+	{
+		if (!isAsleep() && msgRate[0x01][0x07])
+			sendNavPvt(valid, lat, lon);
+	}
+
+	// Ends a backup whose time has run out
+	bool isAsleep()
+	{
+		if (asleep && ((int32_t)(millis() - wakeAt) >= 0))
+			wake();
+		return asleep;
+	}
+
+	// NAV-PVT with a 3D fix (or no fix) at lat/lon 1e-7 degrees
+	void sendNavPvt(bool valid, int32_t lat, int32_t lon)
+	{
+		uint8_t p[92];
+		memset(p, 0, sizeof(p));
+		p[4] = 2017 & 0xFF;
+		p[5] = 2017 >> 8;
+		p[6] = 6;
+		p[7] = 15;
+		p[8] = 12;
+		p[11] = 0x03;
+		p[20] = valid ? 3 : 0;
+		p[21] = valid ? 0x01 : 0x00;
+		p[23] = valid ? 9 : 0;
+		put4(p + 24, lon);
+		put4(p + 28, lat);
+		put4(p + 36, 545400);
+		sendFrame(0x01, 0x07, p, sizeof(p));
+	}
+
+	unsigned long baud;		// rate the receiver's UART runs at
+	unsigned long hostBaud;	// rate Serial1 transmits at
+	uint16_t outProto;
+	uint16_t measRate;
+	uint8_t msgRate[256][256];	// CFG-MSG rate by class and id
+	bool mute;				// ignores everything, as if it weren't there
+	bool fixedBaud;			// ACKs CFG-PRT but stays at its rate
+	int nakRemaining;		// CFG commands still to be refused
+	int commands;			// frames received
+	int polls;				// CFG-PRT polls
+	bool gnssRunning;		// CFG-RST stop/start
+	uint32_t sosDelay;		// ms UPD-SOS takes to write the backup
+	int sosBackups;
+	int sleeps;				// RXM-PMREQ
+	bool asleep;			// in backup, deaf and silent
+	uint32_t wakeAt;		// millis() the backup ends
+	int wakes;
+	int configSaves;		// CFG-CFG saves
+	bool injectedPosition;
+	int32_t injectedLat, injectedLon;
+	bool injectedTime;
+	uint16_t injectedYear;
+	uint8_t injectedMonth, injectedDay, injectedHour;
+	uint16_t injectedAccuracy;	// s
+
+private:
+	struct Byte
+	{
+		uint8_t value;
+		unsigned long baud;	// rate it goes out at
+		uint32_t due;		// millis() it arrives
+	};
+
+	// What CFG-CFG saved, restored on every wake
+	unsigned long savedBaud;
+	uint16_t savedOutProto;
+	uint16_t savedMeasRate;
+	uint8_t savedMsgRate[256][256];
+
+	void saveConfig()
+	{
+		savedBaud = baud;
+		savedOutProto = outProto;
+		savedMeasRate = measRate;
+		memcpy(savedMsgRate, msgRate, sizeof(msgRate));
+	}
+
+	void wake()
+	{
+		asleep = false;
+		wakes++;
+		baud = savedBaud;
+		outProto = savedOutProto;
+		measRate = savedMeasRate;
+		memcpy(msgRate, savedMsgRate, sizeof(msgRate));
+	}
+
+	static void put4(uint8_t* p, uint32_t v)
+	{
+		for (int i = 0; i < 4; i++)
+			p[i] = (v >> (8 * i)) & 0xFF;
+	}
+
+	static uint32_t get4(const uint8_t* p)
+	{
+		return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	void ack(uint8_t cls, uint8_t id, bool ok)
+	{
+		uint8_t p[2] = { cls, id };
+		sendFrame(0x05, ok ? 0x01 : 0x00, p, sizeof(p));
+	}
+
+	void parse()
+	{
+		for (;;)
+		{
+			//drop anything before a sync pair, e.g. the 0xFF wake bytes
+			while (!rx.empty() && (rx[0] != 0xB5))
+				rx.erase(rx.begin());
+			if (rx.size() < 8)
+				return;
+			if (rx[1] != 0x62)
+			{
+				rx.erase(rx.begin());
+				continue;
+			}
+
+			size_t len = rx[4] | (rx[5] << 8);
+			if (rx.size() < len + 8)
+				return;
+
+			uint8_t a = 0, b = 0;
+			for (size_t i = 2; i < len + 6; i++)
+			{
+				a += rx[i];
+				b += a;
+			}
+			if ((a == rx[len + 6]) && (b == rx[len + 7]) && !mute)
+				handle(rx[2], rx[3], &rx[6], len);
+			rx.erase(rx.begin(), rx.begin() + len + 8);
+		}
+	}
+
+	void handle(uint8_t cls, uint8_t id, const uint8_t* p, size_t len)
+	{
+		commands++;
+
+		if ((cls == 0x06) && (nakRemaining > 0))
+		{
+			nakRemaining--;
+			ack(cls, id, false);
+			return;
+		}
+
+		if ((cls == 0x06) && (id == 0x00))
+		{
+			if (len == 1)
+			{
+				//poll, the port settings then the ACK
+				polls++;
+				uint8_t prt[20];
+				memset(prt, 0, sizeof(prt));
+				prt[0] = 1;
+				put4(prt + 8, baud);
+				prt[12] = 0x03;
+				prt[14] = outProto & 0xFF;
+				sendFrame(0x06, 0x00, prt, sizeof(prt));
+				ack(cls, id, true);
+			}
+			else if (len == 20)
+			{
+				//the ACK goes out at the old rate, then the port switches
+				ack(cls, id, true);
+				outProto = p[14] | (p[15] << 8);
+				if (!fixedBaud)
+					baud = get4(p + 8);
+			}
+			return;
+		}
+
+		if ((cls == 0x06) && (id == 0x01) && (len == 3))
+			msgRate[p[0]][p[1]] = p[2];
+		else if ((cls == 0x06) && (id == 0x08) && (len == 6))
+			measRate = p[0] | (p[1] << 8);
+
+		if ((cls == 0x06) && (id == 0x09) && (len >= 12) && ((get4(p + 4) & 0x1F) == 0x1F))
+		{
+			//CFG-CFG saving port and message settings
+			saveConfig();
+			configSaves++;
+		}
+
+		if ((cls == 0x06) && (id == 0x04))
+		{
+			//CFG-RST is never acknowledged
+			gnssRunning = (p[2] != 0x08);
+			return;
+		}
+
+		if (cls == 0x06)
+		{
+			ack(cls, id, true);
+			return;
+		}
+
+		if ((cls == 0x09) && (id == 0x14) && (len == 4) && (p[0] == 0))
+		{
+			//UPD-SOS create backup, only written while GNSS is stopped
+			uint8_t r[8] = { 2, 0, 0, 0, (uint8_t)(gnssRunning ? 0 : 1), 0, 0, 0 };
+			if (!gnssRunning)
+				sosBackups++;
+			sendFrame(0x09, 0x14, r, sizeof(r), sosDelay);
+		}
+		else if ((cls == 0x02) && (id == 0x41) && (len == 16))
+		{
+			//RXM-PMREQ, anything still queued for the host is cut off
+			sleeps++;
+			asleep = true;
+			wakeAt = millis() + get4(p + 4);
+			tx.clear();
+		}
+		else if ((cls == 0x13) && (id == 0x40) && (len == 20) && (p[0] == 0x01))
+		{
+			injectedPosition = true;
+			injectedLat = get4(p + 4);
+			injectedLon = get4(p + 8);
+		}
+		else if ((cls == 0x13) && (id == 0x40) && (len == 24) && (p[0] == 0x10))
+		{
+			injectedTime = true;
+			injectedYear = p[4] | (p[5] << 8);
+			injectedMonth = p[6];
+			injectedDay = p[7];
+			injectedHour = p[8];
+			injectedAccuracy = p[16] | (p[17] << 8);
+		}
+	}
+
+	std::vector<uint8_t> rx;	// from the host
+	std::deque<Byte> tx;		// to the host
+};
+
+#endif
@@ -0,0 +1,249 @@
+// 
+// 
+// 
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "EEPROM.h"
+#include "EspSoftSerialRx.h"
+#include <stdarg.h>
+
+HardwareSerial Serial(true);
+HardwareSerial Serial1(false);
+EspClass ESP;
+TwoWire Wire;
+EEPROMClass EEPROM;
+SimSerialPeer* simSoftSerialPeer;
+
+unsigned long String::allocations;
+
+static uint64_t simMicros;
+uint32_t simYieldMicros = 100;
+uint32_t simInterruptsDisabled;
+
+#define SIM_PINS 18
+
+static void (*handlers[SIM_PINS])();
+static int analogValues[SIM_PINS];
+
+unsigned long millis()
+{
+	return (unsigned long)(simMicros / 1000);
+}
+
+unsigned long micros()
+{
+	return (unsigned long)simMicros;
+}
+
+void delay(unsigned long ms)
+{
+	simMicros += ms * 1000ULL;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	simMicros += us;
+}
+
+void yield()
+{
+	simMicros += simYieldMicros;
+}
+
+void simAdvance(uint32_t us)
+{
+	simMicros += us;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+int analogRead(uint8_t pin)
+{
+	return (pin < SIM_PINS) ? analogValues[pin] : 0;
+}
+
+void simAnalog(uint8_t pin, int value)
+{
+	if (pin < SIM_PINS)
+		analogValues[pin] = value;
+}
+
+int digitalPinToInterrupt(uint8_t pin)
+{
+	return pin;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode)
+{
+	if (interrupt < SIM_PINS)
+		handlers[interrupt] = handler;
+}
+
+void detachInterrupt(uint8_t interrupt)
+{
+	if (interrupt < SIM_PINS)
+		handlers[interrupt] = NULL;
+}
+
+bool simInterrupt(uint8_t pin)
+{
+	//masked interrupts would be taken on interrupts(), the tests don't need that
+	if ((pin >= SIM_PINS) || (!handlers[pin]) || simInterruptsDisabled)
+		return false;
+	handlers[pin]();
+	return true;
+}
+
+void noInterrupts()
+{
+	simInterruptsDisabled++;
+}
+
+void interrupts()
+{
+	if (simInterruptsDisabled)
+		simInterruptsDisabled--;
+}
+
+void HardwareSerial::begin(unsigned long rate)
+{
+	baud = rate;
+	if (peer)
+		peer->hostBegin(rate);
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t len)
+{
+	if (peer)
+		peer->hostWrite(data, len);
+	else if (console)
+		fwrite(data, 1, len, stdout);
+	return len;
+}
+
+int HardwareSerial::printf(const char* format, ...)
+{
+	char buf[256];
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	if (n > (int)sizeof(buf) - 1)
+		n = sizeof(buf) - 1;
+	if (n > 0)
+		write((const uint8_t*)buf, n);
+	return n;
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size)
+{
+	if ((offset * 4 + size) > sizeof(rtc))
+		return false;
+	memcpy(data, rtc + offset, size);
+	return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size)
+{
+	if ((offset * 4 + size) > sizeof(rtc))
+		return false;
+	memcpy(rtc + offset, data, size);
+	return true;
+}
+
+bool EspSoftSerialRx::read(byte& c)
+{
+	return enabled && simSoftSerialPeer && simSoftSerialPeer->hostRead(c, baud);
+}
+
+static SimI2cDevice* devices;
+
+SimI2cDevice::SimI2cDevice(uint8_t a) : address(a), pointer(0)
+{
+	memset(regs, 0, sizeof(regs));
+	next = devices;
+	devices = this;
+}
+
+SimI2cDevice::~SimI2cDevice()
+{
+	for (SimI2cDevice** d = &devices; *d; d = &(*d)->next)
+	{
+		if (*d == this)
+		{
+			*d = next;
+			break;
+		}
+	}
+}
+
+TwoWire::TwoWire()
+{
+	transactions = 0;
+	rxLimit = SIM_I2C_BUFFER;
+	txAddress = -1;
+	txLen = 0;
+	rxLen = 0;
+	rxIndex = 0;
+}
+
+SimI2cDevice* TwoWire::find(int address)
+{
+	for (SimI2cDevice* d = devices; d; d = d->next)
+	{
+		if (d->address == address)
+			return d;
+	}
+	return NULL;
+}
+
+void TwoWire::beginTransmission(int address)
+{
+	txAddress = address;
+	txLen = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+	if (txLen >= SIM_I2C_BUFFER)
+		return 0;
+	txBuffer[txLen++] = data;
+	return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool stop)
+{
+	transactions++;
+	SimI2cDevice* d = find(txAddress);
+	if (!d)
+		return 2;	//address NACK
+
+	//first byte sets the register pointer, the rest are written from there on
+	if (txLen > 0)
+	{
+		d->pointer = txBuffer[0];
+		for (uint8_t i = 1; i < txLen; i++)
+			d->written(d->pointer++, txBuffer[i]);
+	}
+	txLen = 0;
+	return 0;
+}
+
+uint8_t TwoWire::requestFrom(int address, int len, bool stop)
+{
+	transactions++;
+	rxLen = 0;
+	rxIndex = 0;
+	SimI2cDevice* d = find(address);
+	if (!d)
+		return 0;
+
+	if (len > rxLimit)
+		len = rxLimit;
+	for (int i = 0; i < len; i++)
+		rxBuffer[rxLen++] = d->read(d->pointer++);
+	return rxLen;
+}
@@ -0,0 +1,131 @@
+// Arduino.h
+
+// Just enough of the ESP8266 Arduino core to build the station's sources on a PC. Time only
+// moves when the code waits (delay, yield) or a test calls simAdvance(), and the peripherals
+// are driven by the sim* hooks below so a test can play the other end of the wire.
+
+#ifndef _ARDUINO_h
+#define _ARDUINO_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#ifndef ARDUINO
+#define ARDUINO 10600	// the IDE passes this on the command line, the Makefile does too
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define INPUT 0x00
+#define OUTPUT 0x01
+#define INPUT_PULLUP 0x02
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define A0 17
+
+#define ICACHE_RAM_ATTR
+#define PROGMEM
+#define memcpy_P memcpy
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#include "WString.h"
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+int analogRead(uint8_t pin);
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+void noInterrupts();
+void interrupts();
+
+// The other end of a serial line, e.g. a simulated GPS receiver
+class SimSerialPeer
+{
+public:
+	virtual ~SimSerialPeer() {}
+
+	// Host changed the rate it transmits at
+	virtual void hostBegin(unsigned long baud) {}
+	// Bytes the host transmitted
+	virtual void hostWrite(const uint8_t* data, size_t len) = 0;
+	// Next byte for a host receiving at baud, false if there is none
+	virtual bool hostRead(uint8_t& c, unsigned long baud) { return false; }
+};
+
+class HardwareSerial
+{
+public:
+	explicit HardwareSerial(bool console) : peer(NULL), console(console), baud(0) {}
+
+	void begin(unsigned long rate);
+	size_t write(uint8_t c) { return write(&c, 1); }
+	size_t write(const uint8_t* data, size_t len);
+	int available() { return 0; }
+	int read() { return -1; }
+	void flush() {}
+
+	int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+	size_t print(const char* s) { return printf("%s", s); }
+	size_t print(const String& s) { return print(s.c_str()); }
+	size_t print(char c) { return printf("%c", c); }
+	size_t print(long v, int base = 10) { return printf((base == 16) ? "%lx" : "%ld", v); }
+	size_t print(int v, int base = 10) { return print((long)v, base); }
+	size_t print(unsigned long v, int base = 10) { return printf((base == 16) ? "%lx" : "%lu", v); }
+	size_t print(unsigned int v, int base = 10) { return print((unsigned long)v, base); }
+	size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+	size_t println() { return print("\n"); }
+	template <typename T>
+	size_t println(T v) { return print(v) + println(); }
+	template <typename T>
+	size_t println(T v, int format) { return print(v, format) + println(); }
+
+	SimSerialPeer* peer;	// gets everything written, console output goes to stdout without one
+	unsigned long getBaud() const { return baud; }
+
+private:
+	bool console;
+	unsigned long baud;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+class EspClass
+{
+public:
+	bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+	bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+	uint32_t getCycleCount() { return (uint32_t)(micros() * 80); }
+
+	uint32_t rtc[128];	// RTC user memory, 512 bytes
+};
+
+extern EspClass ESP;
+
+// Simulation controls
+
+// Moves the clock on, firing nothing, e.g. simAdvance(1000) for a millisecond
+void simAdvance(uint32_t us);
+// Runs whatever attachInterrupt() hooked to pin, as the hardware would on an edge
+bool simInterrupt(uint8_t pin);
+// Sets what analogRead() returns next
+void simAnalog(uint8_t pin, int value);
+
+extern uint32_t simYieldMicros;		// time each yield() takes, so polling loops run out their timeouts
+extern uint32_t simInterruptsDisabled;	// noInterrupts() calls not yet matched by interrupts()
+
+#endif
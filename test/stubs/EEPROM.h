@@ -0,0 +1,41 @@
+// EEPROM.h
+
+#ifndef _EEPROM_h
+#define _EEPROM_h
+
+#include "Arduino.h"
+
+#define SIM_EEPROM_SIZE 4096
+
+// The ESP8266 EEPROM emulation, a RAM image that commit() writes to flash
+class EEPROMClass
+{
+public:
+	EEPROMClass() : commits(0) { memset(data, 0xFF, sizeof(data)); }
+
+	void begin(size_t size) {}
+	uint8_t read(int address) { return data[address]; }
+	void write(int address, uint8_t value) { data[address] = value; }
+	bool commit() { commits++; return true; }
+
+	template <typename T>
+	T& get(int address, T& t)
+	{
+		memcpy(&t, data + address, sizeof(T));
+		return t;
+	}
+
+	template <typename T>
+	const T& put(int address, const T& t)
+	{
+		memcpy(data + address, &t, sizeof(T));
+		return t;
+	}
+
+	uint8_t data[SIM_EEPROM_SIZE];
+	uint16_t commits;	// flash writes so far
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
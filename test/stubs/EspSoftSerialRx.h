@@ -0,0 +1,27 @@
+// EspSoftSerialRx.h
+
+#ifndef _ESPSOFTSERIALRX_h
+#define _ESPSOFTSERIALRX_h
+
+#include "Arduino.h"
+
+// Receive only soft serial, reads whatever simSoftSerialPeer sends at the rate begin() set
+class EspSoftSerialRx
+{
+public:
+	EspSoftSerialRx() : baud(0), enabled(true) {}
+
+	void begin(unsigned long rate, int pin) { baud = rate; }
+	void setEnabled(bool on) { enabled = on; }
+	void reset() {}
+	void service() {}
+	bool read(byte& c);
+
+private:
+	unsigned long baud;
+	bool enabled;
+};
+
+extern SimSerialPeer* simSoftSerialPeer;
+
+#endif
@@ -0,0 +1,88 @@
+// WString.h
+
+// Heap backed String that grows the way the Arduino one does, one realloc per append,
+// so the old String based code can be benchmarked as it ran on the device.
+
+#ifndef _WSTRING_h
+#define _WSTRING_h
+
+#include <stdlib.h>
+#include <string.h>
+
+class String
+{
+public:
+	String() : buffer(NULL), len(0) {}
+	String(const char* s) : buffer(NULL), len(0) { copy(s, strlen(s)); }
+	String(const String& s) : buffer(NULL), len(0) { copy(s.buffer ? s.buffer : "", s.len); }
+	~String() { free(buffer); }
+
+	String& operator=(const String& s)
+	{
+		if (this != &s)
+			copy(s.buffer ? s.buffer : "", s.len);
+		return *this;
+	}
+
+	String& operator+=(char c)
+	{
+		grow(len + 1);
+		buffer[len++] = c;
+		buffer[len] = 0;
+		return *this;
+	}
+
+	String& operator+=(const String& s)
+	{
+		size_t n = s.len;
+		grow(len + n);
+		memcpy(buffer + len, s.buffer, n);
+		len += n;
+		buffer[len] = 0;
+		return *this;
+	}
+
+	unsigned int length() const { return len; }
+	char operator[](unsigned int i) const { return (i < len) ? buffer[i] : 0; }
+	const char* c_str() const { return buffer ? buffer : ""; }
+
+	String substring(unsigned int from, unsigned int to) const
+	{
+		String s;
+		if (to > len)
+			to = len;
+		if (from < to)
+			s.copy(buffer + from, to - from);
+		return s;
+	}
+
+	bool startsWith(const char* prefix) const
+	{
+		size_t n = strlen(prefix);
+		return (n <= len) && (memcmp(buffer, prefix, n) == 0);
+	}
+
+	bool operator==(const char* s) const { return strcmp(c_str(), s) == 0; }
+
+	static unsigned long allocations;	// malloc/realloc calls made by every String so far
+
+private:
+	void grow(size_t n)
+	{
+		buffer = (char*)realloc(buffer, n + 1);
+		allocations++;
+	}
+
+	void copy(const char* s, size_t n)
+	{
+		grow(n);
+		memcpy(buffer, s, n);
+		buffer[n] = 0;
+		len = n;
+	}
+
+	char* buffer;
+	size_t len;
+};
+
+#endif
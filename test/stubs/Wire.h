@@ -0,0 +1,63 @@
+// Wire.h
+
+// I2C master that talks to SimI2cDevice objects instead of a bus. A device is a 256 byte
+// register file with an auto-incrementing pointer, subclasses can react to writes and reads.
+
+#ifndef _WIRE_h
+#define _WIRE_h
+
+#include "Arduino.h"
+
+#define SIM_I2C_BUFFER 32
+
+class SimI2cDevice
+{
+public:
+	explicit SimI2cDevice(uint8_t address);
+	virtual ~SimI2cDevice();
+
+	// A register written by the master, the default just stores it
+	virtual void written(uint8_t reg, uint8_t value) { regs[reg] = value; }
+	// A register about to be read by the master
+	virtual uint8_t read(uint8_t reg) { return regs[reg]; }
+
+	uint8_t address;
+	uint8_t regs[256];
+	uint8_t pointer;	// register the next read starts at
+	SimI2cDevice* next;
+};
+
+class TwoWire
+{
+public:
+	TwoWire();
+
+	void begin() {}
+	void beginTransmission(int address);
+	size_t write(uint8_t data);
+	uint8_t endTransmission(bool stop = true);
+	uint8_t requestFrom(int address, int len, bool stop = true);
+	int available() { return rxLen - rxIndex; }
+	int read() { return (rxIndex < rxLen) ? rxBuffer[rxIndex++] : -1; }
+
+	// pre 1.0 names
+	void send(uint8_t data) { write(data); }
+	int receive() { return read(); }
+
+	uint32_t transactions;	// addressed transfers in either direction
+	uint8_t rxLimit;		// bytes one requestFrom() returns at most, the core's buffer size
+
+private:
+	SimI2cDevice* find(int address);
+
+	int txAddress;
+	uint8_t txBuffer[SIM_I2C_BUFFER];
+	uint8_t txLen;
+	uint8_t rxBuffer[SIM_I2C_BUFFER];
+	uint8_t rxLen;
+	uint8_t rxIndex;
+};
+
+extern TwoWire Wire;
+
+#endif
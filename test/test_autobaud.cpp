@@ -0,0 +1,106 @@
+// Ublox::begin() finding a simulated receiver's rate, moving it to 115200 with a confirming
+// round trip, and starting from the remembered rate on the next boot.
+
+#include "ublox.h"
+#include "simreceiver.h"
+#include <EEPROM.h>
+#include "check.h"
+
+static void eraseEeprom()
+{
+	memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+}
+
+static uint32_t storedBaud()
+{
+	UbxStored stored;
+	EEPROM.get(UBX_EEPROM_ADDR, stored);
+	return (stored.magic == UBX_EEPROM_MAGIC) ? stored.baud : 0;
+}
+
+static void testFirstBoot()
+{
+	eraseEeprom();
+	SimReceiver receiver(38400);
+	Ublox ublox;
+
+	CHECK(ublox.begin());
+	CHECK(receiver.baud == 115200);
+	CHECK(ublox.getBaud() == 115200);
+	CHECK(Serial1.getBaud() == 115200);
+	CHECK(storedBaud() == 115200);
+
+	//9600 first and unanswered, then 38400, then the confirming poll at 115200
+	CHECK(receiver.polls == 2);
+
+	//still talking at the new rate
+	CHECK(ublox.setBaud(115200));
+	const UbxProfile profile = { 1000, false, 1, 0, 0 };
+	CHECK(ublox.configure(profile));
+}
+
+static void testReboot()
+{
+	SimReceiver receiver(115200);
+	Ublox ublox;
+
+	//the rate from the first boot is tried first and answers straight away
+	uint16_t commits = EEPROM.commits;
+	uint32_t start = millis();
+	CHECK(ublox.begin());
+	CHECK(receiver.polls == 1);
+	CHECK(millis() - start < UBX_ACK_TIMEOUT);
+	CHECK(ublox.getBaud() == 115200);
+	CHECK(EEPROM.commits == commits);
+}
+
+static void testReceiverReset()
+{
+	//the receiver lost its setting and is back at the factory 9600
+	SimReceiver receiver(9600);
+	Ublox ublox;
+
+	CHECK(ublox.begin());
+	CHECK(receiver.baud == 115200);
+	CHECK(ublox.getBaud() == 115200);
+	CHECK(storedBaud() == 115200);
+}
+
+static void testSwitchRefused()
+{
+	eraseEeprom();
+	SimReceiver receiver(9600);
+	receiver.fixedBaud = true;
+	Ublox ublox;
+
+	//the poll at 115200 goes unanswered, so the link drops back to where the receiver is
+	CHECK(ublox.begin());
+	CHECK(receiver.baud == 9600);
+	CHECK(ublox.getBaud() == 9600);
+	CHECK(storedBaud() == 9600);
+	const UbxProfile profile = { 1000, false, 1, 0, 0 };
+	CHECK(ublox.configure(profile));
+}
+
+static void testNoReceiver()
+{
+	eraseEeprom();
+	SimReceiver receiver(9600);
+	receiver.mute = true;
+	Ublox ublox;
+
+	uint32_t start = millis();
+	CHECK(!ublox.begin());
+	CHECK(ublox.getBaud() == 9600);
+	CHECK(millis() - start < 8 * (UBX_ACK_TIMEOUT + 10));
+}
+
+int main()
+{
+	testFirstBoot();
+	testReboot();
+	testReceiverReset();
+	testSwitchRefused();
+	testNoReceiver();
+	return checkResult();
+}
@@ -0,0 +1,255 @@
+// BaroSampler against a simulated BMP085 fed synthetic UT/UP counts: the decimated
+// ULTRALOWPOWER stream has less noise per unit of time than ULTRAHIGHRES reads but more
+// per bus transaction, a bad read is caught before the decimator, and the CIC itself has
+// unity gain.
+
+#include "baro.h"
+#include <Wire.h>
+#include <random>
+#include "check.h"
+
+// Datasheet example: UT 27898 and UP 23843 at ULTRALOWPOWER compensate to 15.0 C and 69964 Pa
+static const Bmp085Calibration datasheet = { 408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868 };
+#define UT 27898
+#define UP 23843
+
+// Datasheet RMS noise by oversampling, Pa
+static const double noisePa[] = { 6, 5, 4, 3 };
+
+static int32_t compensate(uint8_t oss, int32_t up)
+{
+	int32_t ut = UT, t, p;
+	bmp085Compensate(&datasheet, oss, &ut, &up, &t, &p, 1);
+	return p;
+}
+
+// A BMP085 at 0x77, a write of the control register fills 0xF6.. with UT or a noisy UP
+class SimBmp085 : public SimI2cDevice
+{
+public:
+	SimBmp085() : SimI2cDevice(BMP085_I2CADDR), random(1), spikeNext(false)
+	{
+		regs[0xD0] = 0x55;
+		const int16_t* cal = (const int16_t*)&datasheet;
+		for (int i = 0; i < 11; i++)
+		{
+			regs[BMP085_CAL_AC1 + 2 * i] = (uint16_t)cal[i] >> 8;
+			regs[BMP085_CAL_AC1 + 2 * i + 1] = cal[i] & 0xFF;
+		}
+		paPerCount = compensate(0, UP + 100) - compensate(0, UP);
+		paPerCount /= 100;
+	}
+
+	virtual void written(uint8_t reg, uint8_t value)
+	{
+		regs[reg] = value;
+		if (reg != BMP085_CONTROL)
+			return;
+
+		if (value == BMP085_READTEMPCMD)
+		{
+			regs[0xF6] = UT >> 8;
+			regs[0xF7] = UT & 0xFF;
+		}
+		else if ((value & 0x3F) == BMP085_READPRESSURECMD)
+		{
+			uint8_t oss = value >> 6;
+			std::normal_distribution<double> noise(0, noisePa[oss] / paPerCount * (1 << oss));
+			uint32_t up = lround((UP << oss) + noise(random));
+			if (spikeNext)
+				up = (UP << oss) / 2;
+			spikeNext = false;
+			up <<= 8 - oss;
+			regs[0xF6] = up >> 16;
+			regs[0xF7] = (up >> 8) & 0xFF;
+			regs[0xF8] = up & 0xFF;
+		}
+	}
+
+	std::mt19937 random;
+	double paPerCount;
+	bool spikeNext;	// the next pressure reads far off, like a glitched transfer
+};
+
+static void testCompensation()
+{
+	SimBmp085 sim;
+	Adafruit_BMP085 bmp;
+	CHECK(bmp.begin(BMP085_ULTRALOWPOWER));
+	CHECK(bmp.getCalibration().ac6 == 23153);
+	CHECK(bmp.getCalibration().mc == -8711);
+	CHECK(compensate(0, UP) == 69964);
+	//the same UP at any oversampling is the same pressure, give or take the integer rounding
+	CHECK(abs(compensate(3, UP << 3) - 69964) <= 1);
+}
+
+// ms of simulated time and RMS error in Pa of n outputs after the first
+static void decimated(uint8_t log2R, int n, double& ms, double& rms, uint32_t& transactions)
+{
+	SimBmp085 sim;
+	Adafruit_BMP085 bmp;
+	CHECK(bmp.begin(BMP085_ULTRALOWPOWER));
+	bmp.setTemperatureRefresh(8, 5000);
+	BaroSampler baro(bmp);
+	baro.begin(log2R);
+
+	//the first output, once the combs have settled, starts the clock
+	while (!baro.available())
+	{
+		baro.service();
+		simAdvance(1000);
+	}
+	baro.read();
+
+	uint32_t start = millis();
+	uint32_t bus = Wire.transactions;
+	double sum2 = 0;
+	for (int outputs = 0; outputs < n; )
+	{
+		baro.service();
+		if (baro.available())
+		{
+			double e = baro.read() / (double)(1 << BARO_FRAC_BITS) - 69964;
+			sum2 += e * e;
+			outputs++;
+		}
+		simAdvance(1000);
+	}
+	ms = (double)(millis() - start) / n;
+	rms = sqrt(sum2 / n);
+	transactions = (Wire.transactions - bus) / n;
+	CHECK(baro.getOutliers() == 0);
+}
+
+static void hardware(int n, double& ms, double& rms, uint32_t& transactions)
+{
+	SimBmp085 sim;
+	Adafruit_BMP085 bmp;
+	CHECK(bmp.begin(BMP085_ULTRAHIGHRES));
+
+	uint32_t start = millis();
+	uint32_t bus = Wire.transactions;
+	double sum2 = 0;
+	for (int i = 0; i < n; i++)
+	{
+		double e = bmp.readPressure() - compensate(BMP085_ULTRAHIGHRES, UP << BMP085_ULTRAHIGHRES);
+		sum2 += e * e;
+	}
+	ms = (double)(millis() - start) / n;
+	rms = sqrt(sum2 / n);
+	transactions = (Wire.transactions - bus) / n;
+}
+
+static void testNoisePerTime()
+{
+	double cicMs, cicRms, uhrMs, uhrRms;
+	uint32_t cicBus, uhrBus;
+	decimated(4, 400, cicMs, cicRms, cicBus);
+	hardware(2000, uhrMs, uhrRms, uhrBus);
+
+	//noise power times the time, and times the bus transactions, one output takes, lower is
+	//better at any output rate
+	double cic = cicRms * cicRms * cicMs;
+	double uhr = uhrRms * uhrRms * uhrMs;
+	double cicPerBus = cicRms * cicRms * cicBus;
+	double uhrPerBus = uhrRms * uhrRms * uhrBus;
+	printf("CIC R=16       %5.1f ms/output  %4.2f Pa rms  %u transactions  %6.1f Pa^2 ms  %5.1f Pa^2 transactions\n",
+		cicMs, cicRms, cicBus, cic, cicPerBus);
+	printf("ULTRAHIGHRES   %5.1f ms/output  %4.2f Pa rms  %u transactions  %6.1f Pa^2 ms  %5.1f Pa^2 transactions\n",
+		uhrMs, uhrRms, uhrBus, uhr, uhrPerBus);
+
+	CHECK(uhrRms > 2.5 && uhrRms < 3.5);
+	CHECK(cicRms < 2);
+	//the trade baro.h documents: quieter per unit of time, the chip's oversampling is quieter per transaction
+	CHECK(cic < uhr);
+	CHECK(uhrPerBus < cicPerBus);
+}
+
+static void testSpike()
+{
+	SimBmp085 sim;
+	Adafruit_BMP085 bmp;
+	CHECK(bmp.begin(BMP085_ULTRALOWPOWER));
+	BaroSampler baro(bmp);
+	baro.begin(4);
+
+	//one glitched read some way in, tens of kPa off
+	int outputs = 0;
+	double worst = 0;
+	for (int i = 0; outputs < 40; i++)
+	{
+		if (i == 300)
+			sim.spikeNext = true;
+		baro.service();
+		if (baro.available())
+		{
+			double e = fabs(baro.read() / (double)(1 << BARO_FRAC_BITS) - 69964);
+			if (e > worst)
+				worst = e;
+			outputs++;
+		}
+		simAdvance(1000);
+	}
+	CHECK(baro.getOutliers() == 1);
+	CHECK(worst < 10);
+}
+
+static void testCic()
+{
+	//white noise around a constant, R=16
+	CicDecimator cic;
+	cic.begin(4);
+	std::mt19937 random(1);
+	std::normal_distribution<double> noise(0, 6);
+	int32_t y;
+	int outputs = 0;
+	double sum = 0, sum2 = 0;
+	for (int i = 0; i < 16 * 2000; i++)
+	{
+		if (cic.push(101325 + lround(noise(random)), y))
+		{
+			double e = y / (double)(1 << BARO_FRAC_BITS) - 101325;
+			sum += e;
+			sum2 += e * e;
+			outputs++;
+		}
+	}
+	//two outputs are dropped while the combs fill, sinc^2 noise gain is 2/(3R)
+	CHECK(outputs == 1998);
+	CHECK(fabs(sum / outputs) < 0.2);
+	CHECK(fabs(sqrt(sum2 / outputs) - 6 * sqrt(2.0 / 48)) < 0.15);
+
+	//exact unity gain at the smallest and largest decimation, no overflow at R=64
+	cic.begin(1);
+	outputs = 0;
+	for (int i = 0; i < 20; i++)
+	{
+		if (cic.push(100000, y))
+		{
+			CHECK(y == (100000 << BARO_FRAC_BITS));
+			outputs++;
+		}
+	}
+	CHECK(outputs == 8);
+
+	cic.begin(BARO_MAX_DECIMATION);
+	outputs = 0;
+	for (int i = 0; i < 64 * 4; i++)
+	{
+		if (cic.push(110000, y))
+		{
+			CHECK(y == (110000 << BARO_FRAC_BITS));
+			outputs++;
+		}
+	}
+	CHECK(outputs == 2);
+}
+
+int main()
+{
+	testCompensation();
+	testNoisePerTime();
+	testSpike();
+	testCic();
+	return checkResult();
+}
@@ -0,0 +1,176 @@
+// The BMA180 data ready path against a simulated chip on a simulated clock: the ISR never
+// touches the bus, service() reads each announced sample in order with the edge's time, a
+// read without new_data isn't queued twice, and samples the chip replaced before service()
+// got to them are counted as missed.
+
+#include "bma180.h"
+#include <Wire.h>
+#include "check.h"
+
+#define INT_PIN 13
+#define SAMPLE_PERIOD 1000	// us, 1 kHz data ready
+
+// A BMA180 at 0x40 whose acceleration registers hold a counter, x = n, y = -n, z = 2n, with
+// new_data_x set until they're read. Each sample pulses INT.
+class SimBma180 : public SimI2cDevice
+{
+public:
+	SimBma180() : SimI2cDevice(BMA180_DEFAULT_ADDRESS), n(0), edges(0), sampleOnRead(false) {}
+
+	void sample()
+	{
+		n++;
+		put(0x02, n);
+		put(0x04, -n);
+		put(0x06, 2 * n);
+		regs[0x08] = 25;
+		if (simInterrupt(INT_PIN))
+			edges++;
+	}
+
+	virtual uint8_t read(uint8_t reg)
+	{
+		if ((reg == 0x02) && sampleOnRead)
+		{
+			sampleOnRead = false;
+			sample();
+		}
+		uint8_t v = regs[reg];
+		//new_data_x clears once x has been read
+		if (reg == 0x02)
+			regs[0x02] &= ~0x01;
+		return v;
+	}
+
+	int16_t n;
+	uint32_t edges;
+	bool sampleOnRead;	// the next read races a new sample in
+
+private:
+	void put(uint8_t reg, int16_t v)
+	{
+		uint16_t u = (uint16_t)(v << 2);
+		regs[reg] = (u & 0xFC) | 0x01;
+		regs[reg + 1] = u >> 8;
+	}
+};
+
+static BMA180* begin(SimBma180& chip)
+{
+	static BMA180 bma;
+	bma.beginISR(INT_PIN);
+	bma.missed = 0;
+	return &bma;
+}
+
+// service() after every sample: everything arrives, in order, stamped with its edge
+static void testEverySample()
+{
+	SimBma180 chip;
+	BMA180& bma = *begin(chip);
+
+	int16_t x[8], y[8], z[8], temp[8];
+	uint32_t time[8];
+	int16_t expected = chip.n + 1;
+	int bad = 0;
+	for (int i = 0; i < 1000; i++)
+	{
+		simAdvance(SAMPLE_PERIOD);
+		uint32_t edge = micros();
+		uint32_t before = Wire.transactions;
+		chip.sample();
+		if (Wire.transactions != before)
+			bad++;
+
+		//the loop gets round a little later
+		simAdvance(200);
+		bma.service();
+		if ((bma.drain(x, y, z, temp, time, 8) != 1) || (x[0] != expected) || (y[0] != -expected) ||
+			(z[0] != 2 * expected) || (temp[0] != 25) || (time[0] != edge))
+			bad++;
+		expected++;
+	}
+	CHECK(chip.edges == 1000);
+	CHECK(bad == 0);
+	CHECK(bma.missed == 0);
+	CHECK(bma.samples.overflows == 0);
+}
+
+// service() every fourth sample: one read per call, the three before it counted as missed
+static void testLateService()
+{
+	SimBma180 chip;
+	BMA180& bma = *begin(chip);
+
+	int16_t x[8], y[8], z[8];
+	uint32_t time[8];
+	int bad = 0;
+	for (int i = 0; i < 100; i++)
+	{
+		uint32_t edge = 0;
+		for (int k = 0; k < 4; k++)
+		{
+			simAdvance(SAMPLE_PERIOD);
+			edge = micros();
+			chip.sample();
+		}
+		bma.service();
+		if ((bma.drain(x, y, z, NULL, time, 8) != 1) || (x[0] != chip.n) || (time[0] != edge))
+			bad++;
+	}
+	CHECK(bad == 0);
+	CHECK(bma.missed == 300);
+}
+
+// Nothing announced, nothing read
+static void testIdle()
+{
+	SimBma180 chip;
+	BMA180& bma = *begin(chip);
+
+	uint32_t before = Wire.transactions;
+	for (int i = 0; i < 10; i++)
+		bma.service();
+	CHECK(Wire.transactions == before);
+	CHECK(bma.samples.isEmpty());
+}
+
+// A sample lands between service() taking the edge count and reading the registers: it's read
+// once, its own edge then finds no new_data and is dropped, and the sample it replaced is missed
+static void testEdgeDuringRead()
+{
+	SimBma180 chip;
+	BMA180& bma = *begin(chip);
+
+	int16_t x[8], y[8], z[8];
+	simAdvance(SAMPLE_PERIOD);
+	chip.sample();
+	chip.sampleOnRead = true;
+	bma.service();
+	CHECK(chip.edges == 2);
+	CHECK(bma.drain(x, y, z, NULL, NULL, 8) == 1);
+	CHECK(x[0] == chip.n);
+
+	uint32_t before = Wire.transactions;
+	bma.service();
+	CHECK(Wire.transactions != before);
+	CHECK(bma.samples.isEmpty());
+	CHECK(bma.missed == 1);
+
+	//and back in step
+	simAdvance(SAMPLE_PERIOD);
+	chip.sample();
+	bma.service();
+	CHECK(bma.drain(x, y, z, NULL, NULL, 8) == 1);
+	CHECK(x[0] == chip.n);
+	CHECK(bma.missed == 1);
+}
+
+int main()
+{
+	testEverySample();
+	testLateService();
+	testIdle();
+	testEdgeDuringRead();
+	return checkResult();
+}
@@ -0,0 +1,111 @@
+// BMA180 configuration against a simulated chip that ignores image register writes while
+// ee_w is clear: begin() reads the shadow in pieces the Wire buffer holds, commit() writes
+// only what changed inside one ee_w window, and the path without a shadow opens the window
+// too, at twice the bus transactions.
+
+#include "bma180.h"
+#include <Wire.h>
+#include "check.h"
+
+// A BMA180 at 0x40 with its power on image, chip_id 3 and version 0x12
+class SimBma180 : public SimI2cDevice
+{
+public:
+	SimBma180() : SimI2cDevice(BMA180_DEFAULT_ADDRESS), accepted(0), locked(0)
+	{
+		regs[0x00] = 0x03;
+		regs[0x01] = 0x12;
+		regs[0x20] = 0x40;	//bw 150 Hz
+		regs[0x21] = 0x01;
+		regs[0x35] = 0x04;	//range 2g
+	}
+
+	virtual void written(uint8_t reg, uint8_t value)
+	{
+		if ((reg >= BMA180_IMAGE_FIRST) && (reg <= BMA180_IMAGE_LAST))
+		{
+			if (!(regs[BMA180_CTRL_REG0] & BMA180_EE_W))
+			{
+				locked++;
+				return;
+			}
+			accepted++;
+		}
+		regs[reg] = value;
+	}
+
+	int accepted;	// image writes with ee_w set
+	int locked;		// image writes dropped, ee_w was clear
+};
+
+// What beginSensors() does on a cold boot
+static void program(BMA180& bma)
+{
+	bma.SetFilter(BMA180::F10HZ);
+	bma.setGSensitivty(BMA180::G4);
+	bma.commit();
+}
+
+static void checkProgrammed(SimBma180& chip)
+{
+	CHECK(chip.locked == 0);
+	CHECK(chip.accepted == 2);
+	CHECK((chip.regs[0x20] >> 4) == BMA180::F10HZ);
+	CHECK((chip.regs[0x20] & 0x0F) == 0);
+	CHECK(((chip.regs[0x35] >> 1) & 0x07) == BMA180::G4);
+	CHECK(chip.regs[0x21] == 0x01);
+	CHECK(!(chip.regs[BMA180_CTRL_REG0] & BMA180_EE_W));
+}
+
+// Returns the transactions begin() and programming took
+static uint32_t testShadow()
+{
+	SimBma180 chip;
+	BMA180 bma;
+
+	//41 bytes over a 32 byte buffer, two reads
+	CHECK(BMA180_SHADOW_SIZE > SIM_I2C_BUFFER);
+	CHECK(bma.begin());
+	CHECK(bma.transactions == 2);
+
+	//served from the shadow, nothing on the bus
+	CHECK(bma.getRegValue(0x35) == 0x04);
+	CHECK(bma.getRegValue(0x21) == 0x01);
+	CHECK(bma.transactions == 2);
+
+	//ee_w on, the two changed registers, ee_w off
+	program(bma);
+	checkProgrammed(chip);
+	CHECK(bma.transactions == 6);
+
+	int id = -1, version = -1;
+	CHECK(bma.getIDs(&id, &version));
+	CHECK((id == 3) && (version == 0x12));
+	return 6;
+}
+
+// Returns the transactions programming took
+static uint32_t testNoShadow()
+{
+	//a core whose buffer can't hold even one chunk, every image write goes to the chip directly
+	Wire.rxLimit = 16;
+	SimBma180 chip;
+	BMA180 bma;
+	CHECK(!bma.begin());
+	bma.transactions = 0;
+
+	program(bma);
+	checkProgrammed(chip);
+	uint32_t transactions = bma.transactions;
+	Wire.rxLimit = SIM_I2C_BUFFER;
+	return transactions;
+}
+
+int main()
+{
+	uint32_t shadow = testShadow();
+	uint32_t direct = testNoShadow();
+	printf("configuration through the shadow %u transactions, register by register %u\n", (unsigned)shadow, (unsigned)direct);
+	CHECK(shadow < direct);
+	return checkResult();
+}
@@ -0,0 +1,141 @@
+// A week of synthetic pressure readings every 2 s replayed into PressureHistory, the running
+// min, max, mean and tendency checked against a rescan of every slot after each one closes,
+// and the Zambretti number against the published straight line fits.
+
+#include "forecast.h"
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "check.h"
+
+#define READING_INTERVAL 2000	// ms
+
+// Weather systems on a 3 day cycle with a shorter wave on top and sensor noise
+static int32_t pressureAt(uint32_t ms, std::mt19937& random)
+{
+	double s = ms / 1000.0;
+	double p = 101300 + 1500 * sin(s / (3 * 86400.0) * 2 * M_PI) + 300 * sin(s / 7000.0);
+	return (int32_t)lround(p) + (int32_t)(random() % 5) - 2;
+}
+
+// Zambretti number from the fits in hPa, true when it matches or sits on a rounding edge
+static bool zambrettiMatches(byte z, int32_t tendency, int32_t p)
+{
+	double hPa = p / 100.0;
+	double exact;
+	int lo, hi;
+	if (tendency <= -PRESSURE_STEADY)
+	{
+		exact = 127 - 0.12 * hPa;
+		lo = 1;
+		hi = 9;
+	}
+	else if (tendency >= PRESSURE_STEADY)
+	{
+		exact = 185 - 0.16 * hPa;
+		lo = 20;
+		hi = 32;
+	}
+	else
+	{
+		exact = 144 - 0.13 * hPa;
+		lo = 10;
+		hi = 19;
+	}
+
+	if (fabs(exact - floor(exact) - 0.5) < 1e-6)
+		return true;
+	int expected = std::min(std::max((int)floor(exact + 0.5), lo), hi);
+	return z == expected;
+}
+
+static void testWeek()
+{
+	PressureHistory history;
+	std::mt19937 random(1);
+	std::vector<int32_t> slots;
+	int64_t slotSum = 0;
+	int slotCount = 0;
+	uint32_t slotStart = 0;
+	int mismatches = 0, wrongForecasts = 0;
+	int bands[3] = { 0, 0, 0 };
+
+	for (uint32_t now = 0; now < 7 * 86400000UL; now += READING_INTERVAL)
+	{
+		int32_t p = pressureAt(now, random);
+		history.update(now, p);
+
+		slotSum += p;
+		slotCount++;
+		if (now - slotStart < PRESSURE_HISTORY_INTERVAL)
+			continue;
+
+		//a slot closed, rescan the window
+		slots.push_back((int32_t)((slotSum + slotCount / 2) / slotCount));
+		slotSum = 0;
+		slotCount = 0;
+		slotStart += PRESSURE_HISTORY_INTERVAL;
+
+		size_t n = std::min(slots.size(), (size_t)PRESSURE_HISTORY_SIZE);
+		std::vector<int32_t>::iterator first = slots.end() - n;
+		int64_t sum = 0;
+		for (std::vector<int32_t>::iterator i = first; i != slots.end(); i++)
+			sum += *i;
+		int32_t tendency = slots.back() - *first;
+
+		if ((history.count() != n) ||
+			(history.minimum() != *std::min_element(first, slots.end())) ||
+			(history.maximum() != *std::max_element(first, slots.end())) ||
+			(history.mean() != (int32_t)((sum + n / 2) / n)) ||
+			(history.tendency() != tendency))
+			mismatches++;
+
+		byte z = history.forecast(p);
+		if (n < PRESSURE_HISTORY_SIZE)
+		{
+			if (z != 0)
+				wrongForecasts++;
+			continue;
+		}
+		if (!zambrettiMatches(z, tendency, p))
+			wrongForecasts++;
+		bands[(z <= 9) ? 0 : ((z <= 19) ? 1 : 2)]++;
+	}
+
+	CHECK(slots.size() == 7 * 86400000UL / PRESSURE_HISTORY_INTERVAL - 1);
+	CHECK(mismatches == 0);
+	CHECK(wrongForecasts == 0);
+
+	//the 3 day cycle swings hard enough for every band
+	CHECK(bands[0] > 0);
+	CHECK(bands[1] > 0);
+	CHECK(bands[2] > 0);
+}
+
+static void testGap()
+{
+	PressureHistory history;
+	uint32_t now = 0;
+	for (; now <= 3 * PRESSURE_HISTORY_INTERVAL; now += READING_INTERVAL)
+		history.update(now, 100000);
+	CHECK(history.count() == 3);
+
+	//an hour without readings, then a different pressure, nothing may be averaged across the gap
+	now += 3600000UL;
+	uint32_t resume = now;
+	for (; now < resume + PRESSURE_HISTORY_INTERVAL; now += READING_INTERVAL)
+		history.update(now, 99000);
+	CHECK(history.count() == 3);
+	history.update(now, 99000);
+	CHECK(history.count() == 4);
+	CHECK(history.minimum() == 99000);
+	CHECK(history.maximum() == 100000);
+	CHECK(history.tendency() == -1000);
+}
+
+int main()
+{
+	testWeek();
+	testGap();
+	return checkResult();
+}
@@ -0,0 +1,155 @@
+// Ublox::configure() against a simulated receiver: the profile ends up in the receiver,
+// a NAK is retried, a receiver that never answers costs a bounded time and counts naks, and
+// a saved configuration brings the fixes back after a backup cycle.
+
+#include "ublox.h"
+#include "simreceiver.h"
+#include "check.h"
+
+// CFG commands configure() sends: PRT, six NMEA MSGs, three NAV MSGs, RATE
+#define PROFILE_COMMANDS 11
+
+static const byte nmeaIds[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
+
+static void testUbxOnly()
+{
+	SimReceiver receiver;
+	Ublox ublox;
+	CHECK(ublox.begin(9600));
+
+	const UbxProfile profile = { 500, false, 1, 5, 0 };
+	int before = receiver.commands;
+	CHECK(ublox.configure(profile));
+	CHECK(receiver.commands - before == PROFILE_COMMANDS);
+	CHECK(ublox.naks == 0);
+
+	CHECK(receiver.outProto == 0x0001);
+	for (byte i = 0; i < sizeof(nmeaIds); i++)
+		CHECK(receiver.msgRate[UBX_CLASS_NMEA][nmeaIds[i]] == 0);
+	CHECK(receiver.msgRate[UBX_CLASS_NAV][UBX_NAV_PVT] == 1);
+	CHECK(receiver.msgRate[UBX_CLASS_NAV][UBX_NAV_TIMEUTC] == 5);
+	CHECK(receiver.msgRate[UBX_CLASS_NAV][UBX_NAV_SOL] == 0);
+	CHECK(receiver.measRate == 500);
+	CHECK(receiver.baud == 9600);
+}
+
+static void testNmeaKept()
+{
+	SimReceiver receiver;
+	Ublox ublox;
+	CHECK(ublox.begin(9600));
+
+	const UbxProfile profile = { 1000, true, 0, 0, 1 };
+	CHECK(ublox.configure(profile));
+	CHECK(receiver.outProto == 0x0003);
+	for (byte i = 0; i < sizeof(nmeaIds); i++)
+		CHECK(receiver.msgRate[UBX_CLASS_NMEA][nmeaIds[i]] == 1);
+	CHECK(receiver.msgRate[UBX_CLASS_NAV][UBX_NAV_PVT] == 0);
+	CHECK(receiver.msgRate[UBX_CLASS_NAV][UBX_NAV_SOL] == 1);
+}
+
+static void testNakRetried()
+{
+	SimReceiver receiver;
+	Ublox ublox;
+	CHECK(ublox.begin(9600));
+
+	//the first two commands are refused and each gets sent again
+	receiver.nakRemaining = 2;
+	int before = receiver.commands;
+	const UbxProfile profile = { 1000, false, 1, 0, 0 };
+	CHECK(ublox.configure(profile));
+	CHECK(receiver.commands - before == PROFILE_COMMANDS + 2);
+	CHECK(ublox.naks == 0);
+	CHECK(receiver.msgRate[UBX_CLASS_NAV][UBX_NAV_PVT] == 1);
+
+	//refused every time, given up after UBX_RETRIES
+	receiver.nakRemaining = UBX_RETRIES;
+	before = receiver.commands;
+	CHECK(!ublox.configure(profile));
+	CHECK(receiver.commands - before == PROFILE_COMMANDS + UBX_RETRIES - 1);
+	CHECK(ublox.naks == 1);
+}
+
+static void testNoAnswer()
+{
+	SimReceiver receiver;
+	Ublox ublox;
+	CHECK(ublox.begin(9600));
+
+	receiver.mute = true;
+	uint32_t start = millis();
+	const UbxProfile profile = { 1000, false, 1, 0, 0 };
+	CHECK(!ublox.configure(profile));
+	uint32_t elapsed = millis() - start;
+
+	CHECK(ublox.naks == PROFILE_COMMANDS);
+	CHECK(elapsed >= PROFILE_COMMANDS * UBX_RETRIES * UBX_ACK_TIMEOUT);
+	CHECK(elapsed < PROFILE_COMMANDS * UBX_RETRIES * (UBX_ACK_TIMEOUT + 10));
+}
+
+// Backs the receiver up for ms, lets it wake by itself or through wake() after half the
+// time, then returns whether the next solution reached the host as a fix
+static bool sleepCycle(SimReceiver& receiver, Ublox& ublox, uint32_t ms, bool early)
+{
+	ublox.sleep(ms);
+	CHECK(receiver.asleep);
+	if (early)
+	{
+		simAdvance(ms * 500UL);
+		ublox.wake();
+	}
+	while (ublox.isAsleep())
+		simAdvance(100000);
+	CHECK(!receiver.isAsleep());
+
+	receiver.navigate(true, 481172979, 115166675);
+	for (int i = 0; i < 10; i++)
+	{
+		if (ublox.service())
+			return true;
+	}
+	return false;
+}
+
+static void testSleepWake()
+{
+	SimReceiver receiver;
+	Ublox ublox;
+	CHECK(ublox.begin());
+	const UbxProfile profile = { 1000, false, 1, 0, 0 };
+	CHECK(ublox.configure(profile));
+	CHECK(ublox.setPowerMode(Ublox::PM_BACKUP));
+	CHECK(ublox.saveConfig());
+	CHECK(receiver.configSaves == 1);
+
+	CHECK(sleepCycle(receiver, ublox, 5000, false));
+	CHECK(sleepCycle(receiver, ublox, 60000, true));
+	CHECK(receiver.wakes == 2);
+	CHECK(receiver.baud == UBX_BAUD);
+	CHECK(receiver.outProto == 0x0001);
+	CHECK(ublox.getFix().valid);
+}
+
+static void testSleepUnsaved()
+{
+	//the receiver wakes at its old rate with NAV-PVT off, nothing comes through
+	SimReceiver receiver;
+	Ublox ublox;
+	CHECK(ublox.begin());
+	const UbxProfile profile = { 1000, false, 1, 0, 0 };
+	CHECK(ublox.configure(profile));
+	CHECK(!sleepCycle(receiver, ublox, 5000, false));
+	CHECK(receiver.baud == 9600);
+}
+
+int main()
+{
+	testUbxOnly();
+	testNmeaKept();
+	testNakRetried();
+	testNoAnswer();
+	testSleepWake();
+	testSleepUnsaved();
+	return checkResult();
+}
@@ -0,0 +1,132 @@
+// Ublox::saveState() backing the receiver up without blocking the loop, and restoreState()
+// handing the stored position back to it on the next boot, with the time only when there's a clock.
+
+#include "ublox.h"
+#include "simreceiver.h"
+#include <EEPROM.h>
+#include "check.h"
+
+#define LAT 481172979
+#define LON 115166675
+
+static void getFix(SimReceiver& receiver, Ublox& ublox)
+{
+	receiver.sendNavPvt(true, LAT, LON);
+	for (int i = 0; (i < 10) && !ublox.getFix().valid; i++)
+		ublox.service();
+}
+
+static void testSave()
+{
+	memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+	SimReceiver receiver;
+	Ublox ublox;
+	CHECK(ublox.begin(9600));
+	getFix(receiver, ublox);
+	CHECK(ublox.getFix().valid);
+
+	//returns straight away with GNSS stopped for the backup
+	uint32_t start = millis();
+	ublox.saveState();
+	CHECK(millis() == start);
+	CHECK(ublox.isSaving());
+	CHECK(!receiver.gnssRunning);
+
+	//the loop keeps running while the receiver writes its flash
+	int loops = 0;
+	while (ublox.isSaving() && (loops < 10000))
+	{
+		ublox.service();
+		simAdvance(1000);
+		loops++;
+	}
+	CHECK(!ublox.isSaving());
+	CHECK(ublox.stateSaved);
+	CHECK(receiver.sosBackups == 1);
+	CHECK(receiver.gnssRunning);
+	CHECK(millis() - start >= receiver.sosDelay);
+	CHECK(millis() - start < receiver.sosDelay + 10);
+	CHECK(ublox.getBackupAge() == 0);
+}
+
+static void testSaveUnanswered()
+{
+	SimReceiver receiver;
+	Ublox ublox;
+	CHECK(ublox.begin(9600));
+	getFix(receiver, ublox);
+
+	receiver.mute = true;
+	uint32_t start = millis();
+	ublox.saveState();
+	while (ublox.isSaving())
+	{
+		ublox.service();
+		simAdvance(1000);
+	}
+	CHECK(!ublox.stateSaved);
+	CHECK(millis() - start >= UBX_SOS_TIMEOUT);
+	CHECK(millis() - start < UBX_SOS_TIMEOUT + 10);
+
+	//the restart still goes out, the receiver isn't left stopped
+	receiver.mute = false;
+	ublox.saveState();
+	CHECK(!receiver.gnssRunning);
+	while (ublox.isSaving())
+	{
+		ublox.service();
+		simAdvance(1000);
+	}
+	CHECK(receiver.gnssRunning);
+}
+
+static void testRestore()
+{
+	//next boot, EEPROM still has the fix from testSave()
+	SimReceiver receiver;
+	Ublox ublox;
+	CHECK(ublox.begin(9600));
+	ublox.restoreState();
+
+	CHECK(receiver.injectedPosition);
+	CHECK(receiver.injectedLat == LAT);
+	CHECK(receiver.injectedLon == LON);
+
+	//a fix from the same day finds the backup recent, nothing to save again
+	getFix(receiver, ublox);
+	CHECK(ublox.getBackupAge() < 86400);
+
+	//no clock, no time
+	CHECK(!receiver.injectedTime);
+
+	ublox.restoreState(gpsEpoch(2018, 1, 2, 3, 0, 0));
+	CHECK(receiver.injectedTime);
+	CHECK(receiver.injectedYear == 2018);
+	CHECK(receiver.injectedMonth == 1);
+	CHECK(receiver.injectedDay == 2);
+	CHECK(receiver.injectedHour == 3);
+	CHECK(receiver.injectedAccuracy == 60);
+}
+
+static void testNothingStored()
+{
+	memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+	SimReceiver receiver;
+	Ublox ublox;
+	CHECK(ublox.begin(9600));
+	ublox.restoreState();
+	CHECK(!receiver.injectedPosition);
+	CHECK(!receiver.injectedTime);
+	CHECK(ublox.getBackupAge() == 0);
+	getFix(receiver, ublox);
+	CHECK(ublox.getBackupAge() > 10 * 365 * 86400UL);
+}
+
+int main()
+{
+	testSave();
+	testSaveUnanswered();
+	testRestore();
+	testNothingStored();
+	return checkResult();
+}
@@ -0,0 +1,99 @@
+// 
+// 
+// 
+
+#include "trig.h"
+
+#define TRIG_HALF_PI 1.57079632679f
+#define TRIG_PI 3.14159265359f
+#define TRIG_2_PI 0.636619772368f	// 2 / pi
+
+// A&S 4.4.49 scaled to quarter millidegrees, z^2 in Q15
+#define ATAN_C1 229152
+#define ATAN_C3 (-75699)
+#define ATAN_C5 41285
+#define ATAN_C7 (-19511)
+#define ATAN_C9 4775
+
+int32_t atan2Milli(int32_t y, int32_t x)
+{
+	uint32_t ax = (x < 0) ? -(uint32_t)x : x;
+	uint32_t ay = (y < 0) ? -(uint32_t)y : y;
+	if ((ax | ay) == 0)
+		return 0;
+
+	//fold into the first octant, z = min / max in Q16
+	bool steep = ay > ax;
+	uint32_t num = steep ? ax : ay;
+	uint32_t den = steep ? ay : ax;
+	while (den >= 0x10000)
+	{
+		num >>= 1;
+		den >>= 1;
+	}
+	uint32_t z = ((num << 16) + (den >> 1)) / den;
+	if (z > 0xFFFF)
+		z = 0xFFFF;
+	int32_t z2 = (z * z + 0x10000) >> 17;
+
+	//inner terms stay under 2^31 (largest is 49150 * 2^15), rounded at every step so the errors don't pile up
+	int32_t p = ATAN_C9;
+	p = ATAN_C7 + ((p * z2 + 0x4000) >> 15);
+	p = ATAN_C5 + ((p * z2 + 0x4000) >> 15);
+	p = ATAN_C3 + ((p * z2 + 0x4000) >> 15);
+	p = ATAN_C1 + ((p * z2 + 0x4000) >> 15);
+	int32_t a = ((uint32_t)((p + 2) >> 2) * z + 0x8000) >> 16;
+
+	if (steep)
+		a = 90000 - a;
+	if (x < 0)
+		a = 180000 - a;
+	return (y < 0) ? -a : a;
+}
+
+float fastAtan2f(float y, float x)
+{
+	float ax = fabsf(x);
+	float ay = fabsf(y);
+	if ((ax == 0) && (ay == 0))
+		return 0;
+
+	bool steep = ay > ax;
+	float z = steep ? ax / ay : ay / ax;
+	float z2 = z * z;
+	float a = z * (0.9998660f + z2 * (-0.3302995f + z2 * (0.1801410f + z2 * (-0.0851330f + z2 * 0.0208351f))));
+
+	if (steep)
+		a = TRIG_HALF_PI - a;
+	if (x < 0)
+		a = TRIG_PI - a;
+	return (y < 0) ? -a : a;
+}
+
+float fastAsinf(float x)
+{
+	if (x >= 1)
+		return TRIG_HALF_PI;
+	if (x <= -1)
+		return -TRIG_HALF_PI;
+	return fastAtan2f(x, sqrtf(1 - x * x));
+}
+
+void fastSinCosf(float a, float* s, float* c)
+{
+	//nearest quadrant, pi/2 split in two so the remainder keeps its precision
+	int32_t q = (int32_t)(a * TRIG_2_PI + ((a < 0) ? -0.5f : 0.5f));
+	float r = (a - q * 1.5703125f) - q * 4.83826794897e-4f;
+	float r2 = r * r;
+
+	float sr = r * (1 + r2 * (-1.0f / 6 + r2 * (1.0f / 120 - r2 * (1.0f / 5040))));
+	float cr = 1 + r2 * (-0.5f + r2 * (1.0f / 24 + r2 * (-1.0f / 720 + r2 * (1.0f / 40320))));
+
+	switch (q & 3)
+	{
+	case 0: *s = sr; *c = cr; break;
+	case 1: *s = cr; *c = -sr; break;
+	case 2: *s = -sr; *c = -cr; break;
+	default: *s = -cr; *c = sr; break;
+	}
+}
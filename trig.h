@@ -0,0 +1,29 @@
+// trig.h
+
+#ifndef _TRIG_h
+#define _TRIG_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+// Polynomial trig without libm's double routines. atan is the 9th order odd polynomial from
+// Abramowitz & Stegun 4.4.49 on an octant, sin and cos are Taylor series on +-pi/4 after
+// folding into a quadrant. Measured maximum errors against libm:
+//   atan2Milli	2 millidegrees for 16 bit inputs, 3.1 once they have to be scaled down
+//   fastAtan2f	0.7 millidegrees (1.2e-5 rad)
+//   fastAsinf	0.7 millidegrees, inputs outside -1..1 are clamped
+//   fastSinCosf	1e-6 for |a| up to 8 pi
+
+// Angle of (x, y) in millidegrees, -180000..180000, all integer with one divide, any int32 inputs.
+int32_t atan2Milli(int32_t y, int32_t x);
+
+// Radians, drop in for atan2f/asinf/sinf/cosf
+float fastAtan2f(float y, float x);
+float fastAsinf(float x);
+void fastSinCosf(float a, float* s, float* c);
+
+#endif
+
@@ -3,71 +3,707 @@
 // 
 
 #include "ublox.h"
+#include <EEPROM.h>
 
-void Ublox::send(byte cls, byte id, byte len, byte* payload)
+#define GPS_UNIX_OFFSET 315964800UL	// 1980-01-06, start of GPS time
+#define GPS_LEAP_SECONDS 18			// GPS - UTC, only used for NAV-SOL which has no UTC fields
+
+// Little endian payload fields, assembled bytewise because the payload isn't aligned
+static uint16_t getU2(const byte* p)
+{
+	return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t getU4(const byte* p)
+{
+	return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int32_t getI4(const byte* p)
+{
+	return (int32_t)getU4(p);
+}
+
+static void putU2(byte* p, uint16_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+}
+
+static void putU4(byte* p, uint32_t v)
+{
+	putU2(p, v & 0xFFFF);
+	putU2(p + 2, v >> 16);
+}
+
+Ublox::Ublox()
 {
-	byte crcA = 0;
-	byte crcB = 0;
-	
-	crcA += cls;
-	crcB += crcA;
+	memset(&fix, 0, sizeof(fix));
+	frames = 0;
+	errors = 0;
+	naks = 0;
+	state = SYNC1;
+	baud = 9600;
+	outProto = 0x0003;
+	ack = ACK_NONE;
+	asleep = false;
+	sleepUntil = 0;
+	wakeTime = 0;
+	cycleOnTime = 0;
+	totalOnTime = 0;
+	startTime = 0;
+	ttff = 0;
+	sosRestore = 0xFF;
+	sosBackup = 0xFF;
+	stateSaved = false;
+	saving = false;
+	saveStart = 0;
+}
 
-	crcA += id;
-	crcB += crcA;
+void Ublox::send(byte cls, byte id, uint16_t len, const byte* payload)
+{
+	byte header[6] = { UBX_SYNC1, UBX_SYNC2, cls, id, (byte)(len & 0xFF), (byte)(len >> 8) }; //length LSB first
+	byte crc[2] = { 0, 0 };
 
-	crcA += (len >> 0) & 0xFF; //LSB first
-	crcB += crcA;
-	crcA += (len >> 8) & 0xFF;
-	crcB += crcA;
+	for (int i = 2; i < 6; i++)
+	{
+		crc[0] += header[i];
+		crc[1] += crc[0];
+	}
 
-	for (int i = 0; i < len; i++)
+	for (uint16_t i = 0; i < len; i++)
 	{
-		crcA += payload[i];
-		crcB += crcA;
+		crc[0] += payload[i];
+		crc[1] += crc[0];
 	}
 
-	Serial1.write(0xB5); //mu
-	Serial1.write(0x62); //B
-	Serial1.write(cls);
-	Serial1.write(id);
-	Serial1.write((len >> 0) & 0xFF);
-	Serial1.write((len >> 8) & 0xFF);
+	Serial1.write(header, sizeof(header));
 	Serial1.write(payload, len);
-	Serial1.write(crcA);
-	Serial1.write(crcB);
+	Serial1.write(crc, sizeof(crc));
+}
+
+void Ublox::send_P(const byte* frame, uint16_t size)
+{
+	byte buf[UBX_FRAME_CHUNK];
+	while (size > 0)
+	{
+		uint16_t n = (size < sizeof(buf)) ? size : sizeof(buf);
+		memcpy_P(buf, frame, n);
+		Serial1.write(buf, n);
+		frame += n;
+		size -= n;
+	}
 }
 
-void Ublox::service()
+bool Ublox::service()
 {
+	bool published = false;
 	byte c;
-	byte lastc;
-	String rx;
+
+	serialRx.service();
 	while (serialRx.read(c))
+		rxBuffer.push(c);
+
+	for (int i = 0; (i < GPS_PARSE_BUDGET) && rxBuffer.pop(c); i++)
+	{
+		if (encode(c))
+			published = true;
+	}
+
+	if (saving)
+		serviceSave();
+
+	return published;
+}
+
+bool Ublox::encode(byte c)
+{
+	bool published = false;
+
+	//NMEA is plain ASCII so it can never contain the first sync byte
+	if ((state != SYNC1) || (c == UBX_SYNC1))
+	{
+		published = decode(c);
+	}
+	else if (nmea.encode((char)c))
+	{
+		fix = nmea.getFix();
+		published = true;
+	}
+
+	if (published && fix.valid && (ttff == 0))
+		ttff = millis() - startTime;
+
+	return published;
+}
+
+bool Ublox::decode(byte c)
+{
+	switch (state)
+	{
+	case SYNC1:
+		state = SYNC2;
+		break;
+
+	case SYNC2:
+		state = (c == UBX_SYNC2) ? CLASS : SYNC1;
+		break;
+
+	case CLASS:
+		cls = c;
+		ckA = c;
+		ckB = ckA;
+		state = ID;
+		break;
+
+	case ID:
+		id = c;
+		ckA += c;
+		ckB += ckA;
+		state = LENGTH_LO;
+		break;
+
+	case LENGTH_LO:
+		len = c;
+		ckA += c;
+		ckB += ckA;
+		state = LENGTH_HI;
+		break;
+
+	case LENGTH_HI:
+		len |= (uint16_t)c << 8;
+		ckA += c;
+		ckB += ckA;
+		index = 0;
+		if (len > UBX_MAX_LENGTH)
+		{
+			//one bad byte here would otherwise swallow up to 64k of UBX and NMEA before the checksum caught it
+			errors++;
+			state = SYNC1;
+		}
+		else
+		{
+			state = (len > 0) ? PAYLOAD : CHECKSUM_A;
+		}
+		break;
+
+	case PAYLOAD:
+		if (index < UBX_MAX_PAYLOAD)
+			payload[index] = c;
+		index++;
+		ckA += c;
+		ckB += ckA;
+		if (index >= len)
+			state = CHECKSUM_A;
+		break;
+
+	case CHECKSUM_A:
+		if (c == ckA)
+		{
+			state = CHECKSUM_B;
+		}
+		else
+		{
+			errors++;
+			state = SYNC1;
+		}
+		break;
+
+	case CHECKSUM_B:
+		state = SYNC1;
+		if (c != ckB)
+		{
+			errors++;
+			return false;
+		}
+		frames++;
+		return handleFrame();
+	}
+
+	return false;
+}
+
+bool Ublox::handleFrame()
+{
+	if (len > UBX_MAX_PAYLOAD)
+		return false;
+
+	if ((cls == UBX_CLASS_ACK) && (len >= 2))
+	{
+		ack = (id == UBX_ACK_ACK) ? ACK_ACK : ACK_NAK;
+		ackCls = payload[0];
+		ackId = payload[1];
+		return false;
+	}
+
+	if ((cls == UBX_CLASS_UPD) && (id == UBX_UPD_SOS) && (len >= 8))
 	{
-		if ((lastc == 0xB5) && (c == 0x62))
+		decodeUpdSos();
+		return false;
+	}
+
+	if (cls == UBX_CLASS_NAV)
+	{
+		switch (id)
 		{
-			Serial.printf("ubx\n");
+		case UBX_NAV_PVT:
+			if (len < 92)
+				return false;
+			decodeNavPvt();
+			return true;
+
+		case UBX_NAV_TIMEUTC:
+			if (len >= 20)
+				decodeNavTimeUtc();
+			break;
+
+		case UBX_NAV_SOL:
+			if (len >= 52)
+				decodeNavSol();
+			break;
 		}
+	}
+
+	return false;
+}
+
+void Ublox::decodeNavPvt()
+{
+	byte valid = payload[11];
+	byte fixType = payload[20];
+	byte flags = payload[21];
+
+	if ((valid & 0x03) == 0x03) //validDate and validTime
+		fix.time = gpsEpoch(getU2(payload + 4), payload[6], payload[7], payload[8], payload[9], payload[10]);
+
+	fix.fixMode = (fixType == 2) ? 2 : ((fixType == 3) || (fixType == 4)) ? 3 : 1;
+	fix.valid = (flags & 0x01) && (fix.fixMode > 1); //gnssFixOK
+	fix.quality = fix.valid ? ((flags & 0x02) ? 2 : 1) : 0; //diffSoln
+	fix.satellites = payload[23];
+
+	fix.lon = getI4(payload + 24);	//already 1e-7 degrees
+	fix.lat = getI4(payload + 28);
+	fix.altitude = getI4(payload + 36) / 10;	//hMSL, mm to cm
+
+	uint32_t gSpeed = getU4(payload + 60) / 10;	//mm/s to cm/s
+	fix.speed = (gSpeed > 0xFFFF) ? 0xFFFF : gSpeed;
+	fix.course = getI4(payload + 64) / 1000;	//1e-5 to 0.01 degrees
+	fix.pdop = getU2(payload + 76);
+}
+
+void Ublox::decodeNavTimeUtc()
+{
+	if (payload[19] & 0x04) //validUTC
+		fix.time = gpsEpoch(getU2(payload + 12), payload[14], payload[15], payload[16], payload[17], payload[18]);
+}
+
+void Ublox::decodeNavSol()
+{
+	byte gpsFix = payload[10];
+	byte flags = payload[11];
+
+	//position is ECEF, converting it needs trig so lat/lon are left to NAV-PVT or RMC
+	if ((flags & 0x0C) == 0x0C) //WKNSET and TOWSET
+		fix.time = GPS_UNIX_OFFSET + (uint32_t)getU2(payload + 8) * 604800UL + getU4(payload) / 1000 - GPS_LEAP_SECONDS;
+
+	fix.fixMode = (gpsFix == 2) ? 2 : ((gpsFix == 3) || (gpsFix == 4)) ? 3 : 1;
+	fix.valid = (flags & 0x01) && (fix.fixMode > 1); //gpsFixOK
+	fix.pdop = getU2(payload + 44);
+	fix.satellites = payload[47];
+}
+
+bool Ublox::waitAck(byte cls, byte id)
+{
+	uint32_t start = millis();
+	while (millis() - start < UBX_ACK_TIMEOUT)
+	{
+		service();
+		if ((ack != ACK_NONE) && (ackCls == cls) && (ackId == id))
+			return ack == ACK_ACK;
+		yield();
+	}
+	return false;
+}
+
+bool Ublox::sendWithAck(byte cls, byte id, uint16_t len, const byte* payload)
+{
+	for (int i = 0; i < UBX_RETRIES; i++)
+	{
+		ack = ACK_NONE;
+		send(cls, id, len, payload);
+		if (waitAck(cls, id))
+			return true;
+	}
+	naks++;
+	return false;
+}
+
+bool Ublox::sendWithAck_P(const byte* frame, uint16_t size)
+{
+	byte frameCls = pgm_read_byte(frame + 2);
+	byte frameId = pgm_read_byte(frame + 3);
+
+	for (int i = 0; i < UBX_RETRIES; i++)
+	{
+		ack = ACK_NONE;
+		send_P(frame, size);
+		if (waitAck(frameCls, frameId))
+			return true;
+	}
+	naks++;
+	return false;
+}
+
+bool Ublox::setMessageRate(byte msgCls, byte msgId, byte rate)
+{
+	byte msg[3] = { msgCls, msgId, rate };
+	return sendWithAck(UBX_CLASS_CFG, UBX_CFG_MSG, sizeof(msg), msg);
+}
+
+bool Ublox::configure(const UbxProfile& profile)
+{
+	bool ok = true;
+
+	//UBX out only, unless NMEA is wanted
+	outProto = profile.nmeaOutput ? 0x0003 : 0x0001;
+	ok &= sendPortConfig(baud, true);
+
+	//with NMEA wanted the standard sentences come once per solution, otherwise they're all switched off
+	if (profile.nmeaOutput)
+	{
+		static const byte nmeaIds[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 }; //GGA GLL GSA GSV RMC VTG
+		for (byte i = 0; i < sizeof(nmeaIds); i++)
+			ok &= setMessageRate(UBX_CLASS_NMEA, nmeaIds[i], 1);
+	}
+	else
+	{
+		ok &= sendWithAck(UbxFrame<UBX_CLASS_CFG, UBX_CFG_MSG, UBX_CLASS_NMEA, 0x00, 0>());
+		ok &= sendWithAck(UbxFrame<UBX_CLASS_CFG, UBX_CFG_MSG, UBX_CLASS_NMEA, 0x01, 0>());
+		ok &= sendWithAck(UbxFrame<UBX_CLASS_CFG, UBX_CFG_MSG, UBX_CLASS_NMEA, 0x02, 0>());
+		ok &= sendWithAck(UbxFrame<UBX_CLASS_CFG, UBX_CFG_MSG, UBX_CLASS_NMEA, 0x03, 0>());
+		ok &= sendWithAck(UbxFrame<UBX_CLASS_CFG, UBX_CFG_MSG, UBX_CLASS_NMEA, 0x04, 0>());
+		ok &= sendWithAck(UbxFrame<UBX_CLASS_CFG, UBX_CFG_MSG, UBX_CLASS_NMEA, 0x05, 0>());
+	}
+
+	ok &= setMessageRate(UBX_CLASS_NAV, UBX_NAV_PVT, profile.pvtRate);
+	ok &= setMessageRate(UBX_CLASS_NAV, UBX_NAV_TIMEUTC, profile.timeUtcRate);
+	ok &= setMessageRate(UBX_CLASS_NAV, UBX_NAV_SOL, profile.solRate);
+
+	//CFG-RATE, one solution per measurement, aligned to GPS time
+	byte rate[6];
+	putU2(rate, profile.measRate);
+	putU2(rate + 2, 1);
+	putU2(rate + 4, 1);
+	ok &= sendWithAck(UBX_CLASS_CFG, UBX_CFG_RATE, sizeof(rate), rate);
+
+	return ok;
+}
+
+void Ublox::decodeUpdSos()
+{
+	if (payload[0] == 2) //backup creation acknowledge
+		sosBackup = payload[4];
+	else if (payload[0] == 3) //system restored from backup
+		sosRestore = payload[4];
+}
+
+bool Ublox::sendPortConfig(uint32_t rate, bool wait)
+{
+	//CFG-PRT for UART1, 8N1, UBX+NMEA in
+	byte prt[20];
+	memset(prt, 0, sizeof(prt));
+	prt[0] = 1;
+	putU4(prt + 4, 0x000008D0);
+	putU4(prt + 8, rate);
+	putU2(prt + 12, 0x0003);
+	putU2(prt + 14, outProto);
+
+	if (wait)
+		return sendWithAck(UBX_CLASS_CFG, UBX_CFG_PRT, sizeof(prt), prt);
+
+	send(UBX_CLASS_CFG, UBX_CFG_PRT, sizeof(prt), prt);
+	return true;
+}
+
+void Ublox::setLinkBaud(uint32_t rate)
+{
+	Serial1.begin(rate);
+	serialRx.begin(rate, 12);
+
+	//anything half received belongs to the old rate
+	rxBuffer.clear();
+	state = SYNC1;
+	nmea.reset();
+	baud = rate;
+}
+
+bool Ublox::poll()
+{
+	//polling CFG-PRT for UART1 gets the port settings back followed by an ACK
+	ack = ACK_NONE;
+	send(UbxFrame<UBX_CLASS_CFG, UBX_CFG_PRT, 1>());
+	return waitAck(UBX_CLASS_CFG, UBX_CFG_PRT);
+}
+
+void Ublox::loadStored(UbxStored& stored)
+{
+	EEPROM.get(UBX_EEPROM_ADDR, stored);
+	if (stored.magic != UBX_EEPROM_MAGIC)
+	{
+		memset(&stored, 0, sizeof(stored));
+		stored.magic = UBX_EEPROM_MAGIC;
+	}
+}
+
+void Ublox::saveStored(const UbxStored& stored)
+{
+	EEPROM.put(UBX_EEPROM_ADDR, stored);
+	EEPROM.commit();
+}
+
+uint32_t Ublox::detectBaud()
+{
+	static const uint32_t rates[] = { 9600, 38400, 115200, 57600, 19200, 230400, 4800 };
+
+	UbxStored stored;
+	loadStored(stored);
+	if (stored.baud != 0)
+	{
+		setLinkBaud(stored.baud);
+		if (poll())
+			return baud;
+	}
+
+	for (byte i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+	{
+		if (rates[i] == stored.baud)
+			continue;
+
+		setLinkBaud(rates[i]);
+		if (poll())
+			return baud;
+	}
+
+	return 0;
+}
+
+bool Ublox::setBaud(uint32_t rate)
+{
+	uint32_t old = baud;
+	if (rate == old)
+		return true;
+
+	//the ACK may come back at either rate, so confirm with a round trip at the new one instead
+	sendPortConfig(rate, false);
+	Serial1.flush();
+	delay(UBX_BAUD_SETTLE);
+
+	setLinkBaud(rate);
+	if (!poll())
+	{
+		setLinkBaud(old);
+		return false;
+	}
+	return true;
+}
+
+bool Ublox::setPowerMode(POWERMODE mode, uint32_t period)
+{
+	bool ok = true;
+
+	if (mode == PM_CYCLIC)
+	{
+		//CFG-PM2 version 1, cyclic tracking, ephemeris kept up to date while tracking
+		byte pm2[44];
+		memset(pm2, 0, sizeof(pm2));
+		pm2[0] = 1;
+		putU4(pm2 + 4, (1UL << 17) | (1UL << 12));
+		putU4(pm2 + 8, period);		//updatePeriod
+		putU4(pm2 + 12, 10000);		//searchPeriod when the fix is lost
+		ok &= sendWithAck(UBX_CLASS_CFG, UBX_CFG_PM2, sizeof(pm2), pm2);
+		ok &= sendWithAck(UbxFrame<UBX_CLASS_CFG, UBX_CFG_RXM, 8, 1>());
+	}
+	else
+	{
+		//backup is commanded per cycle, between commands the receiver runs at full power
+		ok &= sendWithAck(UbxFrame<UBX_CLASS_CFG, UBX_CFG_RXM, 8, 0>());
+	}
+
+	return ok;
+}
+
+bool Ublox::saveConfig()
+{
+	//CFG-CFG, save ioPort, msgConf, infMsg, navConf and rxmConf to BBR
+	return sendWithAck(UbxFrame<UBX_CLASS_CFG, UBX_CFG_CFG, UBX_U4(0), UBX_U4(0x1F), UBX_U4(0), 0x01>());
+}
+
+void Ublox::sleep(uint32_t ms)
+{
+	//RXM-PMREQ version 0, backup for ms, UART RX edge also wakes it
+	byte req[16];
+	memset(req, 0, sizeof(req));
+	putU4(req + 4, ms);
+	putU4(req + 8, 0x06);		//backup, force
+	putU4(req + 12, 0x08);		//wakeup on uartrx
+	send(UBX_CLASS_RXM, UBX_RXM_PMREQ, sizeof(req), req);
+
+	uint32_t now = millis();
+	cycleOnTime = now - wakeTime;
+	totalOnTime += cycleOnTime;
+
+	asleep = true;
+	sleepUntil = now + ms;
+}
+
+void Ublox::wake()
+{
+	if (!asleep)
+		return;
+
+	for (byte i = 0; i < UBX_WAKE_BYTES; i++)
+		Serial1.write(0xFF);
+
+	asleep = false;
+	wakeTime = millis();
+}
+
+bool Ublox::isAsleep()
+{
+	if (asleep && ((int32_t)(millis() - sleepUntil) >= 0))
+	{
+		asleep = false;
+		wakeTime = sleepUntil;
+	}
+	return asleep;
+}
+
+uint32_t Ublox::getOnTime()
+{
+	return isAsleep() ? 0 : millis() - wakeTime;
+}
+
+bool Ublox::begin(uint32_t rate)
+{
+	startTime = millis();
+	wakeTime = startTime;
+	ttff = 0;
+	EEPROM.begin(UBX_EEPROM_SIZE);
+
+	if (detectBaud() == 0)
+	{
+		//nothing answered, leave the link at the receiver's factory default
+		setLinkBaud(9600);
+		return false;
+	}
+
+	setBaud(rate);
+
+	UbxStored stored;
+	loadStored(stored);
+	if (stored.baud != baud)
+	{
+		stored.baud = baud;
+		saveStored(stored);
+	}
+
+	return true;
+}
+
+void Ublox::saveState()
+{
+	if (saving)
+		return;
 
-		rx += (char)c;
-		lastc = c;
+	if (fix.valid)
+	{
+		UbxStored stored;
+		loadStored(stored);
+		stored.lat = fix.lat;
+		stored.lon = fix.lon;
+		stored.altitude = fix.altitude;
+		stored.time = fix.time;
+		stored.hasPosition = true;
+		saveStored(stored);
 	}
 
+	//controlled GNSS stop, the receiver only writes its backup while stopped
+	send(UbxFrame<UBX_CLASS_CFG, UBX_CFG_RST, UBX_U2(0), 0x08, 0>());
+	sosBackup = 0xFF;
+	send(UbxFrame<UBX_CLASS_UPD, UBX_UPD_SOS, 0, 0, 0, 0>());
 
+	saving = true;
+	saveStart = millis();
 }
 
-void Ublox::begin()
+uint32_t Ublox::getBackupAge()
 {
-	
-	Serial1.begin(38400);
+	if (!fix.valid)
+		return 0;
+
+	UbxStored stored;
+	loadStored(stored);
+	return fix.time - stored.time;
+}
+
+void Ublox::serviceSave()
+{
+	if ((sosBackup == 0xFF) && (millis() - saveStart < UBX_SOS_TIMEOUT))
+		return;
+
+	//controlled GNSS start, so this is safe to call without cutting power afterwards
+	send(UbxFrame<UBX_CLASS_CFG, UBX_CFG_RST, UBX_U2(0), 0x09, 0>());
+
+	saving = false;
+	stateSaved = (sosBackup == 1);
+}
 
-	//send UBX41 message to GPS to set baud, protocol etc
-	Serial1.printf("$PUBX,41,1,0003,0003,9600,0*30\r\n");
+void Ublox::restoreState(uint32_t now, uint16_t timeAccuracy)
+{
+	UbxStored stored;
+	loadStored(stored);
 
-	Serial1.begin(9600);
+	if (stored.hasPosition)
+	{
+		//MGA-INI-POS_LLH
+		byte pos[20];
+		memset(pos, 0, sizeof(pos));
+		pos[0] = 0x01;
+		putU4(pos + 4, stored.lat);
+		putU4(pos + 8, stored.lon);
+		putU4(pos + 12, stored.altitude);
+		putU4(pos + 16, UBX_POS_ACCURACY);
+		send(UBX_CLASS_MGA, UBX_MGA_INI, sizeof(pos), pos);
+	}
 
-	Serial1.printf("$PUBX,41,1,0003,0003,9600,0*30\r\n");
+	if (now != 0)
+	{
+		//MGA-INI-TIME_UTC, leap seconds unknown
+		uint32_t days = now / 86400UL;
+		uint32_t secs = now % 86400UL;
 
-	serialRx.begin(38400, 12);
+		//civil from days, the inverse of gpsEpoch()
+		int32_t z = days + 719468;
+		int32_t era = z / 146097;
+		int32_t doe = z - era * 146097;
+		int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		int32_t mp = (5 * doy + 2) / 153;
+		byte day = doy - (153 * mp + 2) / 5 + 1;
+		byte month = (mp < 10) ? mp + 3 : mp - 9;
+		uint16_t year = yoe + era * 400 + ((month <= 2) ? 1 : 0);
 
-}
\ No newline at end of file
+		byte tm[24];
+		memset(tm, 0, sizeof(tm));
+		tm[0] = 0x10;
+		tm[3] = 0x80;	//leapSecs -128 = unknown
+		putU2(tm + 4, year);
+		tm[6] = month;
+		tm[7] = day;
+		tm[8] = secs / 3600;
+		tm[9] = (secs / 60) % 60;
+		tm[10] = secs % 60;
+		putU2(tm + 16, timeAccuracy);
+		send(UBX_CLASS_MGA, UBX_MGA_INI, sizeof(tm), tm);
+	}
+}
@@ -10,17 +10,214 @@
 #endif
 
 #include <EspSoftSerialRx.h>
+#include "gpsfix.h"
+#include "nmea.h"
+#include "ringbuffer.h"
+#include "ubxframe.h"
+
+#define GPS_PARSE_BUDGET 64	// bytes decoded per service() call, bounds the time spent in one go
+#define UBX_MAX_PAYLOAD 100	// NAV-PVT is 92 bytes, anything longer is checksummed but not kept
+#define UBX_MAX_LENGTH 1024	// longer is taken as a corrupted header rather than waited out
+#define UBX_FRAME_CHUNK 32	// bytes of a flash frame copied out per write, static frames fit in one
+
+#define UBX_CLASS_NAV 0x01
+#define UBX_CLASS_RXM 0x02
+#define UBX_CLASS_ACK 0x05
+#define UBX_CLASS_CFG 0x06
+#define UBX_CLASS_UPD 0x09
+#define UBX_CLASS_MGA 0x13
+#define UBX_CLASS_NMEA 0xF0
+
+#define UBX_NAV_SOL 0x06
+#define UBX_NAV_PVT 0x07
+#define UBX_NAV_TIMEUTC 0x21
+#define UBX_ACK_NAK 0x00
+#define UBX_ACK_ACK 0x01
+#define UBX_CFG_PRT 0x00
+#define UBX_CFG_MSG 0x01
+#define UBX_CFG_RST 0x04
+#define UBX_CFG_RATE 0x08
+#define UBX_CFG_CFG 0x09
+#define UBX_CFG_RXM 0x11
+#define UBX_CFG_PM2 0x3B
+#define UBX_RXM_PMREQ 0x41
+#define UBX_UPD_SOS 0x14
+#define UBX_MGA_INI 0x40
+
+#define UBX_ACK_TIMEOUT 250	// ms to wait for ACK-ACK/ACK-NAK
+#define UBX_RETRIES 3
+#define UBX_BAUD 115200		// link rate begin() switches the receiver to
+#define UBX_BAUD_SETTLE 50	// ms for the receiver to change rate
+
+#define UBX_WAKE_BYTES 8	// 0xFF bytes sent to pull the receiver out of backup early
+#define UBX_SOS_TIMEOUT 2000	// ms for the receiver to write its backup to flash
+#define UBX_POS_ACCURACY 10000	// cm, stated accuracy of an injected last known position
+
+#define UBX_EEPROM_ADDR 0
+#define UBX_EEPROM_SIZE 64
+#define UBX_EEPROM_MAGIC 0x5544
+
+// Kept in EEPROM so the next boot tries the right rate first and can give the receiver a head start
+struct UbxStored
+{
+	uint16_t magic;
+	uint32_t baud;
+	int32_t lat;		// last valid fix, 1e-7 degrees
+	int32_t lon;
+	int32_t altitude;	// cm
+	uint32_t time;		// UTC seconds of that fix, which is also when saveState() last ran, 0 = none
+	bool hasPosition;
+};
+
+// What the receiver should put on the UART, applied by Ublox::configure()
+struct UbxProfile
+{
+	uint16_t measRate;	// ms between navigation solutions
+	bool nmeaOutput;	// false leaves only UBX on the UART
+	byte pvtRate;		// NAV-PVT every n solutions, 0 = off
+	byte timeUtcRate;	// NAV-TIMEUTC
+	byte solRate;		// NAV-SOL
+};
 
 class Ublox
 {
 public:
-	void begin();
-	void Ublox::service();
-	void Ublox::send(byte cls, byte id, byte len, byte* payload);
+	// CONTINUOUS keeps full power, CYCLIC lets the receiver duty cycle itself (CFG-PM2),
+	// BACKUP means the host puts it to sleep between samples with sleep()
+	typedef enum { PM_CONTINUOUS, PM_CYCLIC, PM_BACKUP } POWERMODE;
+
+	Ublox();
+
+	// Finds the rate the receiver is talking at and moves it to the requested one,
+	// returns false if the receiver never answered
+	bool begin(uint32_t rate = UBX_BAUD);
+
+	// Switches receiver and link together, confirmed with a poll round trip
+	bool setBaud(uint32_t rate);
+	uint32_t getBaud() const { return baud; }
+
+	// Drains the receiver into a ring buffer and decodes a bounded slice of it,
+	// returns true when a new fix has been published by NAV-PVT or RMC
+	bool service();
+
+	// Feed one received byte, UBX frames are decoded here and everything else goes to the NMEA parser
+	bool encode(byte c);
+
+	// Builds the frame around a payload at runtime
+	void send(byte cls, byte id, uint16_t len, const byte* payload);
+
+	// Writes a frame in flash that already has its sync, length and checksum, e.g. a UbxFrame.
+	// It's copied out UBX_FRAME_CHUNK bytes at a time, so a static frame goes in one write.
+	void send_P(const byte* frame, uint16_t size);
+
+	template <byte CLS, byte ID, byte... PAYLOAD>
+	void send(const UbxFrame<CLS, ID, PAYLOAD...>& frame) { send_P(frame.bytes, frame.SIZE); }
+
+	// Sends a CFG message and waits for its ACK, retrying on NAK or timeout
+	bool sendWithAck(byte cls, byte id, uint16_t len, const byte* payload);
+	bool sendWithAck_P(const byte* frame, uint16_t size);
+
+	template <byte CLS, byte ID, byte... PAYLOAD>
+	bool sendWithAck(const UbxFrame<CLS, ID, PAYLOAD...>& frame) { return sendWithAck_P(frame.bytes, frame.SIZE); }
+
+	// Turns off the NMEA sentences, enables only the UBX messages in the profile and sets the nav rate.
+	// Returns false if any of the commands went unacknowledged.
+	bool configure(const UbxProfile& profile);
+
+	// period is the cyclic tracking update period in ms, ignored for the other modes
+	bool setPowerMode(POWERMODE mode, uint32_t period = 0);
+
+	// Saves the port, message, navigation and power settings to battery backed RAM (CFG-CFG).
+	// Call it once configure(), setBaud() and setPowerMode() are done, before the first sleep().
+	// BBR only, so saving on every boot costs no flash wear.
+	bool saveConfig();
+
+	// RXM-PMREQ backup for ms, the receiver wakes itself at the end or on wake(). It comes back
+	// with the configuration last saved by saveConfig(), anything set since is lost.
+	void sleep(uint32_t ms);
+	void wake();
+	bool isAsleep();
+	// ms since the receiver last woke, or since begin(), 0 while asleep
+	uint32_t getOnTime();
+
+	// Keeps the current fix in EEPROM, stops the receiver and has it write its navigation database
+	// to flash (UPD-SOS). Returns at once, service() restarts the receiver when the backup is
+	// acknowledged or after UBX_SOS_TIMEOUT and sets stateSaved. Don't sleep() while isSaving().
+	// Both the EEPROM and the receiver's backup are flash, so rate limit it with getBackupAge().
+	void saveState();
+	bool isSaving() const { return saving; }
+	// s from the last saveState() to the current fix, 0 without a valid fix, huge if it never ran
+	uint32_t getBackupAge();
+
+	// Injects the stored position (MGA-INI-POS_LLH) and the UTC time (MGA-INI-TIME_UTC) so the
+	// receiver can skip most of its search. Call after begin(). The time is only sent when now is
+	// given, the stored fix time says nothing about how long the station was off.
+	void restoreState(uint32_t now = 0, uint16_t timeAccuracy = 60);
+
+	const GpsFix& getFix() const { return fix; }
+
+	uint32_t ttff;		// ms from begin() to the first valid fix, 0 until there is one
+	byte sosRestore;	// UPD-SOS restore status sent at boot, 2 = restored from flash, 0xFF = not seen
+	bool stateSaved;	// the last saveState() backup was acknowledged
+
+	uint32_t cycleOnTime;	// ms the receiver was awake in the last completed sleep cycle
+	uint32_t totalOnTime;	// ms awake across all completed cycles
+
+	uint16_t frames;	// UBX frames that passed the checksum
+	uint16_t errors;	// UBX checksum failures
+	uint16_t naks;		// CFG commands rejected or unanswered
 
 private:
+	typedef enum { SYNC1, SYNC2, CLASS, ID, LENGTH_LO, LENGTH_HI, PAYLOAD, CHECKSUM_A, CHECKSUM_B } STATE;
+
+	typedef enum { ACK_NONE, ACK_ACK, ACK_NAK } ACK;
+
+	bool decode(byte c);
+	bool waitAck(byte cls, byte id);
+	bool poll();
+	uint32_t detectBaud();
+	void setLinkBaud(uint32_t rate);
+	bool sendPortConfig(uint32_t rate, bool wait);
+	void loadStored(UbxStored& stored);
+	void saveStored(const UbxStored& stored);
+	void decodeUpdSos();
+	void serviceSave();
+	bool setMessageRate(byte cls, byte id, byte rate);
+	bool handleFrame();
+	void decodeNavPvt();
+	void decodeNavTimeUtc();
+	void decodeNavSol();
+
 	EspSoftSerialRx serialRx;
+	RingBuffer<byte, 256> rxBuffer;
+	NmeaParser nmea;
+
+	STATE state;
+	byte cls;
+	byte id;
+	uint16_t len;
+	uint16_t index;
+	byte ckA;
+	byte ckB;
+	byte payload[UBX_MAX_PAYLOAD];
+
+	uint32_t baud;	// UART rate the receiver is currently running at
+	uint16_t outProto;	// CFG-PRT output protocols, kept when the rate changes
+
+	bool asleep;
+	uint32_t sleepUntil;	// millis() the receiver wakes itself
+	uint32_t wakeTime;		// millis() of the start of the current on period
+
+	uint32_t startTime;	// millis() at begin(), for ttff
+	byte sosBackup;		// UPD-SOS backup creation response, 0xFF while waiting
+	bool saving;		// GNSS stopped for the backup, waiting on sosBackup
+	uint32_t saveStart;	// millis() the backup was requested
+
+	ACK ack;	// last ACK class message, for the command in ackCls/ackId
+	byte ackCls;
+	byte ackId;
 
+	GpsFix fix;
 };
 
 #endif
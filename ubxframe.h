@@ -0,0 +1,51 @@
+// ubxframe.h
+
+#ifndef _UBXFRAME_h
+#define _UBXFRAME_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#define UBX_SYNC1 0xB5
+#define UBX_SYNC2 0x62
+
+// Little endian multi-byte fields for UbxFrame payloads
+#define UBX_U2(v) ((v) & 0xFF), (((v) >> 8) & 0xFF)
+#define UBX_U4(v) UBX_U2((v) & 0xFFFF), UBX_U2(((v) >> 16) & 0xFFFF)
+
+// Fletcher checksum over class, id, length and payload, ckA in the low byte and ckB in the high byte
+constexpr uint16_t ubxChecksum(byte a, byte b)
+{
+	return a | ((uint16_t)b << 8);
+}
+
+template <typename... T>
+constexpr uint16_t ubxChecksum(byte a, byte b, byte c, T... rest)
+{
+	return ubxChecksum((byte)(a + c), (byte)(b + a + c), rest...);
+}
+
+// A complete UBX message fixed at compile time, e.g.
+//   UbxFrame<UBX_CLASS_CFG, UBX_CFG_MSG, UBX_CLASS_NMEA, 0x00, 0>::bytes
+// is the whole frame including sync and checksum. It is kept in flash (PROGMEM), which the
+// ESP8266 can only read a word at a time, so go through memcpy_P()/pgm_read_byte() or Ublox::send().
+template <byte CLS, byte ID, byte... PAYLOAD>
+struct UbxFrame
+{
+	static const uint16_t LENGTH = sizeof...(PAYLOAD);
+	static const uint16_t CHECKSUM = ubxChecksum(0, 0, CLS, ID, LENGTH & 0xFF, LENGTH >> 8, PAYLOAD...);
+	static const uint16_t SIZE = LENGTH + 8;
+	static const byte bytes[SIZE];
+};
+
+template <byte CLS, byte ID, byte... PAYLOAD>
+const byte UbxFrame<CLS, ID, PAYLOAD...>::bytes[UbxFrame<CLS, ID, PAYLOAD...>::SIZE] PROGMEM =
+{
+	UBX_SYNC1, UBX_SYNC2, CLS, ID, LENGTH & 0xFF, LENGTH >> 8, PAYLOAD..., CHECKSUM & 0xFF, CHECKSUM >> 8
+};
+
+#endif
+